@@ -2,25 +2,48 @@
 
 #include <cassert>
 #include <cmath>
+#include <cstring>
+#include <iterator>
 
 #include "absl/strings/str_format.h"
 #include "absl/strings/str_join.h"
+#include "hash.h"
 
 namespace clips {
 
-// Don't set above 7 without expanding lookup tables in the header.
-constexpr int max_procs = 6;
+namespace {
+
+// True if `a` is more than `b`.  Doubles are allowed a little rounding
+// slack; Fixed values compare exactly.
+bool Exceeds(double a, double b) { return a > b + State::eps; }
+bool Exceeds(Fixed a, Fixed b) { return a > b; }
+
+uint64_t Bits(double d) {
+  uint64_t bits;
+  memcpy(&bits, &d, sizeof(bits));
+  return bits;
+}
+uint64_t Bits(Fixed f) { return f.raw(); }
+
+// Fold `v` into the hash `h`.
+uint64_t HashCombine(uint64_t h, uint64_t v) {
+  return Mix64(h ^ (v + kGoldenGamma));
+}
+
+} // namespace
 
-bool State::IsStrictlyWorseThan(const State &other) const {
+template <typename Scalar, typename Config>
+bool BasicState<Scalar, Config>::IsStrictlyWorseThan(
+    const BasicState &other) const {
   if ((projects_ & kWin) && !(other.projects_ & kWin)) {
     return false;
   }
-  if ((other.projects_ & kWin) && (time_ > other.time_ + eps)) {
+  if ((other.projects_ & kWin) && Exceeds(time_, other.time_)) {
     return true;
   }
-  if (time_ + eps < other.time_ || ops_ > other.ops_ + eps ||
-      creat_ > other.creat_ + eps || clips_ > other.clips_ + eps ||
-      dollars_ > other.dollars_ + eps || processors_ != other.processors_ ||
+  if (Exceeds(other.time_, time_) || Exceeds(ops_, other.ops_) ||
+      Exceeds(creat_, other.creat_) || Exceeds(clips_, other.clips_) ||
+      Exceeds(dollars_, other.dollars_) || processors_ != other.processors_ ||
       memory_ != other.memory_ || auto_clippers_ != other.auto_clippers_ ||
       mlvl_ != other.mlvl_ || (projects_ & other.projects_) != projects_) {
     return false;
@@ -28,200 +51,368 @@ bool State::IsStrictlyWorseThan(const State &other) const {
   return true;
 }
 
-std::unique_ptr<State> State::PassTime(double seconds) const {
-  auto copy = absl::make_unique<State>(*this);
-  copy->time_ += seconds;
-  copy->clips_ += ClipsPerSecond() * seconds;
-  copy->dollars_ += DollarsPerSecond() * seconds;
-  copy->ops_ += OpsPerSecond() * seconds;
-  copy->creat_ = std::min(copy->creat_ + CreatPerSecond() * seconds, 250.);
-  return copy;
+namespace {
+
+// Index of the grid cell holding `value`.  Resources without a tolerance are
+// their own cell.
+double GridCell(double value, double size) {
+  return size > 0. ? std::floor(value / size) : value;
 }
 
-bool State::MeetsPrereqs(uint32_t project) const {
-  if (project & projects_) {
-    // already purchased
-    return false;
+} // namespace
+
+template <typename Scalar, typename Config>
+bool BasicState<Scalar, Config>::IsApproximatelyWorseThan(
+    const BasicState &other, const Tolerance &tol) const {
+  if ((projects_ & kWin) || (other.projects_ & kWin)) {
+    return IsStrictlyWorseThan(other);
   }
-  if (project == kEvenBetterAutoclippers) {
-    return (projects_ & kImprovedAutoclippers);
-  } else if (project == kOptimizedAutoclippers) {
-    return (projects_ & kEvenBetterAutoclippers);
-  } else if (project == kHadwigerClipDiagrams) {
-    return (projects_ & kHadwigerProblem);
-  } else if (project == kOptimizedWireExtrusion) {
-    return (projects_ & kImprovedWireExtrusion);
-  } else if (project == kMicrolatticeShapecasting) {
-    return (projects_ & kOptimizedWireExtrusion);
-  } else if (project == kNewSlogan) {
-    return (projects_ & (kLexicalProcessing | kSloganCreat)) ==
-           (kLexicalProcessing | kSloganCreat);
-  } else if (project == kCatchyJingle) {
-    return (projects_ & (kLexicalProcessing | kSloganCreat)) ==
-           (kLexicalProcessing | kSloganCreat);
-  } else if (project == kHypnoHarmonics) {
-    return (projects_ & kCatchyJingle);
+  if (GridCell(time_, tol.time) < GridCell(other.time_, tol.time) ||
+      GridCell(ops_, tol.ops) > GridCell(other.ops_, tol.ops) ||
+      GridCell(creat_, tol.creat) > GridCell(other.creat_, tol.creat) ||
+      GridCell(clips_, tol.clips) > GridCell(other.clips_, tol.clips) ||
+      GridCell(dollars_, tol.dollars) > GridCell(other.dollars_, tol.dollars) ||
+      processors_ != other.processors_ || memory_ != other.memory_ ||
+      auto_clippers_ != other.auto_clippers_ || mlvl_ != other.mlvl_ ||
+      (projects_ & other.projects_) != projects_) {
+    return false;
   }
   return true;
 }
 
-double State::NextOpsLimit() const {
-  const double ops_limit = 1000. * memory_;
-  if (ops_ == ops_limit || clips_ < 2000.) {
-    return HUGE_VAL; // We aren't earning ops, nothing to save for
-  } else if (ops_ < 750. && MeetsPrereqs(kImprovedAutoclippers)) {
-    return 750.;
-  } else if (ops_ < 1000. && (memory_ == 1 || MeetsPrereqs(kCreativity))) {
-    return 1000.;
-  } else if (ops_ < 1750. && MeetsPrereqs(kImprovedWireExtrusion)) {
-    return 1750.;
-  } else if (ops_ < 2000. && memory_ == 2) {
-    return 2000.;
-  } else if (ops_ < 2500. && (MeetsPrereqs(kEvenBetterAutoclippers) ||
-                              MeetsPrereqs(kNewSlogan))) {
-    return 2500.;
-  } else if (ops_ < 3000. && memory_ == 3) {
-    return 3000.;
-  } else if (ops_ < 3500. && MeetsPrereqs(kOptimizedWireExtrusion)) {
-    return 3500.;
-  } else if (ops_ < 4000. && memory_ == 4) {
-    return 4000.;
-  } else if (ops_ < 5000. &&
-             (memory_ == 5 || MeetsPrereqs(kOptimizedAutoclippers))) {
-    return 5000.;
-  } else if (ops_ < 6000. &&
-             (memory_ == 6 || MeetsPrereqs(kHadwigerClipDiagrams))) {
-    return 6000.;
-  } else if (ops_ < 7000. && memory_ == 7) {
-    return 7000.;
-  } else if (ops_ < 7500. && (MeetsPrereqs(kMicrolatticeShapecasting) ||
-                              MeetsPrereqs(kHypnoHarmonics))) {
-    return 7500.;
-  } else {
-    return ops_limit;
+template <typename Scalar, typename Config>
+uint64_t BasicState<Scalar, Config>::Fingerprint() const {
+  uint64_t h = 0;
+  for (Scalar v : {time_, ops_, creat_, clips_, dollars_}) {
+    h = HashCombine(h, Bits(v));
   }
+  for (int v : {trust_, processors_, memory_, auto_clippers_, mlvl_}) {
+    h = HashCombine(h, uint32_t(v));
+  }
+  h = HashCombine(h, uint64_t(projects_) << 32 | spree_);
+  // Not the purchase log: states that differ only in how they got here are
+  // the same state.
+  h = HashCombine(h, instant_rank_);
+  return h;
 }
 
-std::pair<double, bool> State::NextCreatLimit() const {
-  if (ops_ < memory_ * 1000. || !(projects_ & kCreativity) || creat_ > 250.) {
-    // We aren't earning creat or have bought all creat projects; nothing to
-    // save for
-    return {HUGE_VAL, false};
-  } else if (creat_ < 10. && MeetsPrereqs(kLimerick)) {
-    const uint32_t rest = kSloganCreat | kJingleCreat | kLexicalProcessing |
-                          kCombinatoryHarmonics | kHadwigerProblem |
-                          kTothSausageConjecture | kDonkeySpace;
-    const bool must_buy = ((projects_ & rest) == rest);
-    return {10., must_buy};
-  } else if (creat_ < 25. && MeetsPrereqs(kSloganCreat)) {
-    const uint32_t rest = kJingleCreat | kLexicalProcessing |
-                          kCombinatoryHarmonics | kHadwigerProblem |
-                          kTothSausageConjecture | kDonkeySpace;
-    const bool must_buy = ((projects_ & rest) == rest);
-    return {25., must_buy};
-  } else if (creat_ < 45. && MeetsPrereqs(kJingleCreat)) {
-    const uint32_t rest = kLexicalProcessing | kCombinatoryHarmonics |
-                          kHadwigerProblem | kTothSausageConjecture |
-                          kDonkeySpace;
-    const bool must_buy = ((projects_ & rest) == rest);
-    return {45., must_buy};
-  } else if (creat_ < 50. && MeetsPrereqs(kLexicalProcessing)) {
-    const uint32_t rest = kCombinatoryHarmonics | kHadwigerProblem |
-                          kTothSausageConjecture | kDonkeySpace;
-    const bool must_buy = ((projects_ & rest) == rest);
-    return {50., must_buy};
-  } else if (creat_ < 100. && MeetsPrereqs(kCombinatoryHarmonics)) {
-    const uint32_t rest =
-        kHadwigerProblem | kTothSausageConjecture | kDonkeySpace;
-    const bool must_buy = ((projects_ & rest) == rest);
-    return {100., must_buy};
-  } else if (creat_ < 150. && MeetsPrereqs(kHadwigerProblem)) {
-    const uint32_t rest = kTothSausageConjecture | kDonkeySpace;
-    const bool must_buy = ((projects_ & rest) == rest);
-    return {150., must_buy};
-  } else if (creat_ < 200. && MeetsPrereqs(kTothSausageConjecture)) {
-    const uint32_t rest = kDonkeySpace;
-    const bool must_buy = ((projects_ & rest) == rest);
-    return {200., must_buy};
-  } else if (creat_ < 250. && MeetsPrereqs(kDonkeySpace)) {
-    return {250., true};
+template <typename Scalar, typename Config>
+std::unique_ptr<BasicState<Scalar, Config>>
+BasicState<Scalar, Config>::PassTime(double seconds) const {
+  auto copy = absl::make_unique<BasicState>(*this);
+  if (seconds > 0.) {
+    copy->instant_rank_ = kRankNone;
   }
-  return {HUGE_VAL, false};
+  copy->time_ += Scalar(seconds);
+  copy->clips_ += Scalar(ClipsPerSecond() * seconds);
+  copy->dollars_ += Scalar(DollarsPerSecond() * seconds);
+  copy->ops_ += Scalar(OpsPerSecond() * seconds);
+  copy->creat_ =
+      std::min(copy->creat_ + Scalar(CreatPerSecond() * seconds), Scalar(250.));
+  return copy;
+}
+
+template <typename Scalar, typename Config>
+typename BasicState<Scalar, Config>::BranchInfo
+BasicState<Scalar, Config>::Describe(Decision decision, double seconds,
+                                     uint32_t bought, int trust_earned) const {
+  BranchInfo info;
+  info.decision = decision;
+  info.seconds = seconds;
+  info.from_ = this;
+  info.elapsed_ = seconds;
+  info.bought_ = bought;
+  info.trust_earned_ = trust_earned;
+  return info;
+}
+
+// The resources as PassTime() would leave them.
+template <typename Scalar, typename Config>
+double BasicState<Scalar, Config>::BranchInfo::Ops() const {
+  return double(from_->ops_ + Scalar(from_->OpsPerSecond() * elapsed_));
+}
+
+template <typename Scalar, typename Config>
+double BasicState<Scalar, Config>::BranchInfo::Creat() const {
+  return std::min(
+      double(from_->creat_ + Scalar(from_->CreatPerSecond() * elapsed_)),
+      250.);
+}
+
+template <typename Scalar, typename Config>
+double BasicState<Scalar, Config>::BranchInfo::Clips() const {
+  return double(from_->clips_ + Scalar(from_->ClipsPerSecond() * elapsed_));
+}
+
+template <typename Scalar, typename Config>
+double BasicState<Scalar, Config>::BranchInfo::Dollars() const {
+  return double(from_->dollars_ +
+                Scalar(from_->DollarsPerSecond() * elapsed_));
 }
 
 namespace {
 
+// True if `project` can be bought once `projects` are, ignoring its cost.
+constexpr bool PrereqsMet(uint32_t projects, uint32_t project) {
+  if (project & projects) {
+    // already purchased
+    return false;
+  }
+  switch (project) {
+  case State::kEvenBetterAutoclippers:
+    return (projects & State::kImprovedAutoclippers);
+  case State::kOptimizedAutoclippers:
+    return (projects & State::kEvenBetterAutoclippers);
+  case State::kHadwigerClipDiagrams:
+    return (projects & State::kHadwigerProblem);
+  case State::kOptimizedWireExtrusion:
+    return (projects & State::kImprovedWireExtrusion);
+  case State::kMicrolatticeShapecasting:
+    return (projects & State::kOptimizedWireExtrusion);
+  case State::kNewSlogan:
+  case State::kCatchyJingle:
+    return (projects & (State::kLexicalProcessing | State::kSloganCreat)) ==
+           (State::kLexicalProcessing | State::kSloganCreat);
+  case State::kHypnoHarmonics:
+    return (projects & State::kCatchyJingle);
+  }
+  return true;
+}
+
 struct OpsProject {
   double cost;
   uint32_t project;
-  uint32_t next_project;
+  // Whether a branch saves ops up to this price.  (Catchy Jingle is only
+  // bought with ops already on hand.)
+  bool saved_for;
 };
 
+// Listed in purchase rank order; see State::kRankFirstOpsProject.  Prices
+// don't increase down the list.
 constexpr int kNumOpsProjects = 11;
 constexpr OpsProject kOpsProjects[kNumOpsProjects] = {
-    {7500., State::kHypnoHarmonics, State::kMicrolatticeShapecasting},
-    {7500., State::kMicrolatticeShapecasting, State::kHadwigerClipDiagrams},
-    {6000., State::kHadwigerClipDiagrams, State::kOptimizedAutoclippers},
-    {5000., State::kOptimizedAutoclippers, State::kCatchyJingle},
-    {4500., State::kCatchyJingle, State::kOptimizedWireExtrusion},
-    {3500., State::kOptimizedWireExtrusion, State::kNewSlogan},
-    {2500., State::kNewSlogan, State::kEvenBetterAutoclippers},
-    {2500., State::kEvenBetterAutoclippers, State::kImprovedWireExtrusion},
-    {1750., State::kImprovedWireExtrusion, State::kCreativity},
-    {1000., State::kCreativity, State::kImprovedAutoclippers},
-    {750., State::kImprovedAutoclippers, State::kNothing},
+    {7500., State::kHypnoHarmonics, true},
+    {7500., State::kMicrolatticeShapecasting, true},
+    {6000., State::kHadwigerClipDiagrams, true},
+    {5000., State::kOptimizedAutoclippers, true},
+    {4500., State::kCatchyJingle, false},
+    {3500., State::kOptimizedWireExtrusion, true},
+    {2500., State::kNewSlogan, true},
+    {2500., State::kEvenBetterAutoclippers, true},
+    {1750., State::kImprovedWireExtrusion, true},
+    {1000., State::kCreativity, true},
+    {750., State::kImprovedAutoclippers, true},
 };
 
+struct CreatProject {
+  double cost;
+  uint32_t project;
+  bool earns_trust;
+};
+
+// In order of increasing price.
+constexpr int kNumCreatProjects = 8;
+constexpr CreatProject kCreatProjects[kNumCreatProjects] = {
+    {10., State::kLimerick, true},
+    {25., State::kSloganCreat, false},
+    {45., State::kJingleCreat, false},
+    {50., State::kLexicalProcessing, true},
+    {100., State::kCombinatoryHarmonics, true},
+    {150., State::kHadwigerProblem, true},
+    {200., State::kTothSausageConjecture, true},
+    {250., State::kDonkeySpace, true},
+};
+
+// NextOpsLimit() and NextCreatLimit() look up the projects worth saving for
+// in tables built at compile time, as bitmasks over kOpsProjects and
+// kCreatProjects.
+//
+// Whether an ops project is worth saving for depends on the projects_ bits
+// of its chain of prerequisites.  The autoclipper, wire and Hadwiger
+// projects and the marketing and creativity projects have separate
+// prerequisites, so each group gets its own small table, indexed by just
+// the bits it depends on.
+
+// Bits 0-6 are the autoclipper and wire projects and Clip Diagrams, and
+// bit 7 is the Hadwiger Problem.
+constexpr int kSellWireTableSize = 1 << 8;
+constexpr uint32_t SellWireIndex(uint32_t projects) {
+  return (projects & 0x7f) | (projects >> 7 & 0x80);
+}
+constexpr uint32_t SellWireProjects(uint32_t index) {
+  return (index & 0x7f) | (index & 0x80) << 7;
+}
+
+// Bits 0-3 are the marketing projects and Creativity, bit 4 is Lexical
+// Processing, and bit 5 is the slogan creat project.
+constexpr int kMarketingTableSize = 1 << 6;
+constexpr uint32_t MarketingIndex(uint32_t projects) {
+  return (projects >> 7 & 0xf) | (projects >> 8 & 0x10) |
+         (projects >> 12 & 0x20);
+}
+constexpr uint32_t MarketingProjects(uint32_t index) {
+  return (index & 0xf) << 7 | (index & 0x10) << 8 | (index & 0x20) << 12;
+}
+
+// The creat projects are bits 11-18 of projects_, and have no prerequisites.
+constexpr int kCreatTableSize = 1 << 8;
+constexpr uint32_t CreatIndex(uint32_t projects) {
+  return projects >> 11 & 0xff;
+}
+constexpr uint32_t CreatProjects(uint32_t index) { return index << 11; }
+
+// The ops projects in `group` worth saving for, once `projects` are bought.
+constexpr uint32_t OpsSavingFor(uint32_t projects, uint32_t group) {
+  uint32_t mask = 0;
+  for (int i = 0; i < kNumOpsProjects; ++i) {
+    const OpsProject &item = kOpsProjects[i];
+    if ((item.project & group) && item.saved_for &&
+        PrereqsMet(projects, item.project)) {
+      mask |= 1u << i;
+    }
+  }
+  return mask;
+}
+
+constexpr auto kSellWireSavingFor =
+    MakeTable<kSellWireTableSize>([](uint32_t index) {
+      return OpsSavingFor(SellWireProjects(index), 0x7f);
+    });
+constexpr auto kMarketingSavingFor =
+    MakeTable<kMarketingTableSize>([](uint32_t index) {
+      return OpsSavingFor(MarketingProjects(index), 0x780);
+    });
+constexpr auto kCreatSavingFor =
+    MakeTable<kCreatTableSize>([](uint32_t index) {
+      uint32_t mask = 0;
+      for (int i = 0; i < kNumCreatProjects; ++i) {
+        if (PrereqsMet(CreatProjects(index), kCreatProjects[i].project)) {
+          mask |= 1u << i;
+        }
+      }
+      return mask;
+    });
+
 } // namespace
 
+template <typename Scalar, typename Config>
+bool BasicState<Scalar, Config>::MeetsPrereqs(uint32_t project) const {
+  return PrereqsMet(projects_, project);
+}
+
+template <typename Scalar, typename Config>
+double BasicState<Scalar, Config>::NextOpsLimit() const {
+  const double ops_limit = 1000. * memory_;
+  if (ops_ == ops_limit || clips_ < 2000.) {
+    return HUGE_VAL; // We aren't earning ops, nothing to save for
+  }
+  // The cheapest project worth saving for that we can't afford yet, which
+  // is the one furthest down kOpsProjects.  Reaching the ops cap is a
+  // decision point too, for memory.
+  uint32_t saving_for = kSellWireSavingFor[SellWireIndex(projects_)] |
+                        kMarketingSavingFor[MarketingIndex(projects_)];
+  while (saving_for != 0) {
+    const int i = 31 - __builtin_clz(saving_for);
+    if (ops_ < kOpsProjects[i].cost) {
+      return std::min(kOpsProjects[i].cost, ops_limit);
+    }
+    saving_for &= ~(1u << i);
+  }
+  return ops_limit;
+}
+
+template <typename Scalar, typename Config>
+std::pair<double, bool> BasicState<Scalar, Config>::NextCreatLimit() const {
+  if (ops_ < memory_ * 1000. || !(projects_ & kCreativity) || creat_ > 250.) {
+    // We aren't earning creat or have bought all creat projects; nothing to
+    // save for
+    return {HUGE_VAL, false};
+  }
+  // The cheapest project left that we can't afford yet.  It must be bought
+  // if it is the last one.
+  uint32_t saving_for = kCreatSavingFor[CreatIndex(projects_)];
+  while (saving_for != 0) {
+    const int i = __builtin_ctz(saving_for);
+    if (creat_ < kCreatProjects[i].cost) {
+      return {kCreatProjects[i].cost, (saving_for >> i) == 1};
+    }
+    saving_for &= saving_for - 1;
+  }
+  return {HUGE_VAL, false};
+}
+
+template <typename Scalar, typename Config>
+BasicState<Scalar, Config> *
+BasicState<Scalar, Config>::AddBranch(BranchList *br,
+                                      const BranchFilter *filter,
+                                      Decision decision, double seconds,
+                                      uint32_t bought,
+                                      int trust_earned) const {
+  if (!Accepts(filter, decision, seconds, bought, trust_earned)) {
+    return nullptr;
+  }
+  br->push_back(PassTime(seconds));
+  return br->back().get();
+}
+
 // Potentially purchase things when we reach a threshold.
-void State::AddOpsPurchases(BranchList *br, double ops_thresh,
-                            double ops_thresh_time) const {
-  for (const auto &item : kOpsProjects) {
+template <typename Scalar, typename Config>
+void BasicState<Scalar, Config>::AddOpsPurchases(BranchList *br,
+                                                 const BranchFilter *filter,
+                                                 double ops_thresh,
+                                                 double ops_thresh_time) const {
+  for (int i = 0; i < kNumOpsProjects; ++i) {
+    const auto &item = kOpsProjects[i];
     if (ops_thresh == item.cost && MeetsPrereqs(item.project)) {
-      br->push_back(PassTime(ops_thresh_time));
-      br->back()->ops_ = 0.;
-      br->back()->AwardProject(item.project);
+      if (BasicState *b = AddBranch(br, filter, Decision::kBuyOpsProject,
+                                    ops_thresh_time, item.project)) {
+        b->ops_ = Scalar(0.);
+        b->AwardProject(item.project);
+        b->instant_rank_ = kRankFirstOpsProject + i;
+      }
     }
   }
 }
 
-void State::AddCreatPurchase(BranchList *br, double creat_thresh,
-                             double creat_thresh_time) const {
-  struct Purchase {
-    double cost;
-    uint32_t project;
-    bool earns_trust;
-  };
-  static constexpr Purchase creat_project_list[] = {
-      {10., kLimerick, true},
-      {25., kSloganCreat, false},
-      {45., kJingleCreat, false},
-      {50., kLexicalProcessing, true},
-      {100., kCombinatoryHarmonics, true},
-      {150., kHadwigerProblem, true},
-      {200., kTothSausageConjecture, true},
-      {250., kDonkeySpace, true},
-  };
-  for (const auto &item : creat_project_list) {
+template <typename Scalar, typename Config>
+void BasicState<Scalar, Config>::AddCreatPurchase(
+    BranchList *br, const BranchFilter *filter, double creat_thresh,
+    double creat_thresh_time) const {
+  for (const auto &item : kCreatProjects) {
     if (creat_thresh == item.cost && MeetsPrereqs(item.project)) {
-      br->push_back(PassTime(creat_thresh_time));
-      br->back()->creat_ = 0.;
-      br->back()->AwardProject(item.project);
+      // The spree purchases that follow are branches of their own, so even if
+      // this one is rejected, it is built to make them from.
+      std::unique_ptr<BasicState> rejected;
+      BasicState *b =
+          AddBranch(br, filter, Decision::kBuyCreatProject, creat_thresh_time,
+                    item.project, item.earns_trust ? 1 : 0);
+      if (b == nullptr) {
+        rejected = PassTime(creat_thresh_time);
+        b = rejected.get();
+      }
+      b->creat_ = Scalar(0.);
+      b->AwardProject(item.project);
       if (item.earns_trust) {
-        br->back()->trust_ += 1;
-        br->back()->spree_ = kSpreeProcessor;
+        b->trust_ += 1;
+        b->spree_ = kSpreeProcessor;
       } else {
-        br->back()->spree_ = kSpreeMemory;
+        b->spree_ = kSpreeMemory;
+      }
+      if (rejected) {
+        // Its spree children carry spree_ on, so Branches() finishes the
+        // spree from them.
+        rejected->AddSpreePurchases(br, filter, creat_thresh_time);
       }
     }
   }
 }
 
 // Return a sequence of possible branch states from here.
-State::BranchList State::DoBranches(LimitType limit_type,
-                                    double limit_value) const {
-  State::BranchList ret;
+template <typename Scalar, typename Config>
+typename BasicState<Scalar, Config>::BranchList
+BasicState<Scalar, Config>::DoBranches(LimitType limit_type, double limit_value,
+                                       const BranchFilter *filter) const {
+  BranchList ret;
 
   // Abandon this branch if we are losing money, are capped on creat, are
   // earning creat unnecessarily, or have won.
@@ -237,27 +428,30 @@ State::BranchList State::DoBranches(LimitType limit_type,
     return ret;
   }
 
-  double next_autoclipper_thresh;
+  // Prices are held as Scalar, so the dollars a branch is left with compare
+  // exactly against the prices it saved up for.
+  Scalar next_autoclipper_thresh;
   double dollars_spent = DollarsSpent();
   if (auto_clippers_ > 0) {
     next_autoclipper_thresh =
-        dollars_spent + 5. + std::pow(1.1, auto_clippers_);
+        Scalar(dollars_spent + 5. + std::pow(1.1, auto_clippers_));
   } else {
-    next_autoclipper_thresh = dollars_spent + 5.;
+    next_autoclipper_thresh = Scalar(dollars_spent + 5.);
   }
-  double next_mlvl_thresh = dollars_spent + 50 * std::pow(2., mlvl_);
-  double lower_cost = std::min(next_autoclipper_thresh, next_mlvl_thresh);
-  double higher_cost = std::max(next_autoclipper_thresh, next_mlvl_thresh);
+  Scalar next_mlvl_thresh = Scalar(dollars_spent + 50 * std::pow(2., mlvl_));
+  Scalar lower_cost = std::min(next_autoclipper_thresh, next_mlvl_thresh);
+  Scalar higher_cost = std::max(next_autoclipper_thresh, next_mlvl_thresh);
   bool optional_dollar_purchase = (dollars_ < lower_cost);
-  double dollars_thresh = (dollars_ < lower_cost) ? lower_cost : higher_cost;
+  Scalar dollars_thresh = (dollars_ < lower_cost) ? lower_cost : higher_cost;
   double dollars_thresh_time = (dollars_thresh - dollars_) / dollars_per_second;
 
   // Find next clips threshold
-  static const double clips_limits[11] = {2000.,  3000.,   5000.,   8000.,
-                                          13000., 21000.,  34000.,  55000.,
-                                          89000., 144000., HUGE_VAL};
-  double clips_thresh =
-      *std::upper_bound(clips_limits, clips_limits + 11, clips_);
+  const double *clips_limit =
+      std::upper_bound(std::begin(Config::kClipsThresholds),
+                       std::end(Config::kClipsThresholds), clips_);
+  double clips_thresh = (clips_limit == std::end(Config::kClipsThresholds))
+                            ? HUGE_VAL
+                            : *clips_limit;
   bool halt = false;
   if (limit_type == kClipsLimit && clips_thresh > limit_value) {
     clips_thresh = limit_value;
@@ -293,8 +487,10 @@ State::BranchList State::DoBranches(LimitType limit_type,
         limit_thresh_time < clips_thresh_time &&
         limit_thresh_time < ops_thresh_time &&
         limit_thresh_time < creat_thresh_time) {
-      ret.push_back(PassTime(limit_thresh_time));
-      ret.back()->time_ = limit_value;
+      if (BasicState *b = AddBranch(&ret, filter, Decision::kReachLimit,
+                                    limit_thresh_time)) {
+        b->time_ = Scalar(limit_value);
+      }
       return ret;
     }
   }
@@ -302,23 +498,38 @@ State::BranchList State::DoBranches(LimitType limit_type,
   if (dollars_thresh_time < clips_thresh_time &&
       dollars_thresh_time < ops_thresh_time &&
       dollars_thresh_time < creat_thresh_time) {
-    if (dollars_thresh == next_autoclipper_thresh) {
+    // On a price tie, an earlier branch at this instant may have saved past
+    // the autoclipper; then only the marketing level is left to buy.
+    if (dollars_thresh == next_autoclipper_thresh &&
+        CanPurchaseAfter(dollars_thresh_time, kRankAutoclipper)) {
       // buy an autoclipper
-      ret.push_back(PassTime(dollars_thresh_time));
-      ret.back()->dollars_ = dollars_thresh;
-      ret.back()->auto_clippers_ += 1;
+      if (BasicState *b = AddBranch(&ret, filter, Decision::kBuyAutoclipper,
+                                    dollars_thresh_time)) {
+        b->dollars_ = dollars_thresh;
+        b->auto_clippers_ += 1;
+        b->instant_rank_ = kRankAutoclipper;
+      }
     } else {
       // buy a market level
       assert(dollars_thresh == next_mlvl_thresh);
-      ret.push_back(PassTime(dollars_thresh_time));
-      ret.back()->dollars_ = dollars_thresh;
-      ret.back()->mlvl_ += 1;
-      ret.back()->LogMlvl();
+      if (BasicState *b = AddBranch(&ret, filter, Decision::kBuyMarketing,
+                                    dollars_thresh_time)) {
+        b->dollars_ = dollars_thresh;
+        b->mlvl_ += 1;
+        b->LogMlvl();
+        b->instant_rank_ = kRankMarketing;
+      }
     }
     if (optional_dollar_purchase) {
-      // Branch: Save up for the more expensive thing instead
-      ret.push_back(PassTime(dollars_thresh_time));
-      ret.back()->dollars_ = dollars_thresh;
+      // Branch: Save up for the more expensive thing instead.  If both cost
+      // the same, this must not buy the cheaper one at this same instant.
+      if (BasicState *b = AddBranch(&ret, filter, Decision::kSaveDollars,
+                                    dollars_thresh_time)) {
+        b->dollars_ = dollars_thresh;
+        b->instant_rank_ = (dollars_thresh == next_autoclipper_thresh)
+                               ? kRankAutoclipper
+                               : kRankMarketing;
+      }
     }
     return ret;
   }
@@ -328,58 +539,76 @@ State::BranchList State::DoBranches(LimitType limit_type,
       clips_thresh_time < creat_thresh_time) {
     if (halt) {
       // forced stopping point
-      ret.push_back(PassTime(clips_thresh_time));
-      ret.back()->clips_ = clips_thresh;
+      if (BasicState *b = AddBranch(&ret, filter, Decision::kReachLimit,
+                                    clips_thresh_time)) {
+        b->clips_ = Scalar(clips_thresh);
+      }
       return ret;
     }
     if (clips_thresh == 2000.) {
       // Operations are now online.  (Doesn't earn trust.)
-      ret.push_back(PassTime(clips_thresh_time));
-      ret.back()->clips_ = clips_thresh;
+      if (BasicState *b = AddBranch(&ret, filter, Decision::kOpsOnline,
+                                    clips_thresh_time)) {
+        b->clips_ = Scalar(clips_thresh);
+      }
       return ret;
     }
     int hypno_harmonics = (projects_ & kHypnoHarmonics) ? 1 : 0;
     if (trust_ < memory_ + processors_ + hypno_harmonics) {
       // We earned trust, but were in the red so can't spend now.
       // (This can happen when we spend trust on hypno harmonics.)
-      ret.push_back(PassTime(clips_thresh_time));
-      ret.back()->clips_ = clips_thresh;
-      ret.back()->trust_ += 1;
+      if (BasicState *b = AddBranch(&ret, filter, Decision::kSaveTrust,
+                                    clips_thresh_time, 0, 1)) {
+        b->clips_ = Scalar(clips_thresh);
+        b->trust_ += 1;
+      }
       return ret;
     }
     // Branch options when we are awarded a trust:
     // Branch 1: buy a processor.  Don't buy more than 7.
-    if (processors_ < max_procs) {
-      ret.push_back(PassTime(clips_thresh_time));
-      ret.back()->clips_ = clips_thresh;
-      ret.back()->trust_ += 1;
-      ret.back()->processors_ += 1;
-      ret.back()->LogProcessor();
+    if (processors_ < Config::kMaxProcessors) {
       // If this is the 5th processor and we have 10000 ops, we win!
-      if (processors_ == 5 && ops_ == 10000.) {
-        ret.back()->projects_ |= kWin;
+      const bool win = (processors_ == 5 && ops_ == 10000.);
+      const Decision decision = win ? Decision::kWin : Decision::kBuyProcessor;
+      if (BasicState *b = AddBranch(&ret, filter, decision, clips_thresh_time,
+                                    win ? kWin : 0, 1)) {
+        b->clips_ = Scalar(clips_thresh);
+        b->trust_ += 1;
+        b->processors_ += 1;
+        b->LogProcessor();
+        b->instant_rank_ = kRankProcessor;
+        if (win) {
+          b->projects_ |= kWin;
+        }
+      }
+      if (win) {
         return ret;
       }
     }
     // Branch 2: Don't spend the new trust.  This can happen when:
     //   a) we aren't capped and will buy memory when we hit the cap
     //   b) we are capped, but want to keep earning trust for now
-    // If we already have enough trust to purchase both 10 memory and
+    // If we already have enough trust to fill out memory and purchase
     // hypno harmonics, don't do this: there's nothing left to save for.
-    if (trust_ < processors_ + 11) {
-      ret.push_back(PassTime(clips_thresh_time));
-      ret.back()->clips_ = clips_thresh;
-      ret.back()->trust_ += 1;
+    if (trust_ < processors_ + Config::kMaxMemory + 1) {
+      if (BasicState *b = AddBranch(&ret, filter, Decision::kSaveTrust,
+                                    clips_thresh_time, 0, 1)) {
+        b->clips_ = Scalar(clips_thresh);
+        b->trust_ += 1;
+      }
     }
     // Branch 3: Immediately buy new memory.  This only makes sense if
-    // we're currently capped on ops and don't have 10 memory already.
+    // we're currently capped on ops and don't have all the memory already.
     // TODO(only if all other trust was allocated)
-    if (memory_ < 10 && ops_ == memory_ * 1000.) {
-      ret.push_back(PassTime(clips_thresh_time));
-      ret.back()->clips_ = clips_thresh;
-      ret.back()->trust_ += 1;
-      ret.back()->memory_ += 1;
-      ret.back()->LogMemory();
+    if (memory_ < Config::kMaxMemory && ops_ == memory_ * 1000.) {
+      if (BasicState *b = AddBranch(&ret, filter, Decision::kBuyMemory,
+                                    clips_thresh_time, 0, 1)) {
+        b->clips_ = Scalar(clips_thresh);
+        b->trust_ += 1;
+        b->memory_ += 1;
+        b->LogMemory();
+        b->instant_rank_ = kRankMemory;
+      }
     }
     return ret;
   }
@@ -389,28 +618,35 @@ State::BranchList State::DoBranches(LimitType limit_type,
       ops_thresh_time < creat_thresh_time) {
     // Immediate win?
     if (ops_thresh == 10000. && processors_ >= 5) {
-      ret.push_back(PassTime(ops_thresh_time));
-      ret.back()->ops_ = 10000.;
-      ret.back()->projects_ |= kWin;
+      if (BasicState *b = AddBranch(&ret, filter, Decision::kWin,
+                                    ops_thresh_time, kWin)) {
+        b->ops_ = Scalar(10000.);
+        b->projects_ |= kWin;
+      }
       return ret;
     }
     // Branch 1: If we can purchase anything with ops, add those branches
-    AddOpsPurchases(&ret, ops_thresh, ops_thresh_time);
+    AddOpsPurchases(&ret, filter, ops_thresh, ops_thresh_time);
     // Branch 2: If we're not capped, or if we can start to earn creativity,
     // buy nothing to earn more ops/creat.
     if (ops_thresh != memory_ * 1000. || (projects_ & kCreativity)) {
-      ret.push_back(PassTime(ops_thresh_time));
-      ret.back()->ops_ = ops_thresh;
+      if (BasicState *b =
+              AddBranch(&ret, filter, Decision::kSaveOps, ops_thresh_time)) {
+        b->ops_ = Scalar(ops_thresh);
+      }
     }
     // Branch 3: Buy more memory.  This only works if we're at the cap, and
     // we have the trust to spend.
     int hypno_harmonics = (projects_ & kHypnoHarmonics) ? 1 : 0;
     if (ops_thresh == memory_ * 1000. &&
         trust_ > processors_ + memory_ + hypno_harmonics) {
-      ret.push_back(PassTime(ops_thresh_time));
-      ret.back()->ops_ = ops_thresh;
-      ret.back()->memory_ += 1;
-      ret.back()->LogMemory();
+      if (BasicState *b =
+              AddBranch(&ret, filter, Decision::kBuyMemory, ops_thresh_time)) {
+        b->ops_ = Scalar(ops_thresh);
+        b->memory_ += 1;
+        b->LogMemory();
+        b->instant_rank_ = kRankMemory;
+      }
     }
     return ret;
   }
@@ -419,11 +655,13 @@ State::BranchList State::DoBranches(LimitType limit_type,
       creat_thresh_time < clips_thresh_time &&
       creat_thresh_time < ops_thresh_time) {
     // Branch 1: Buy if you can
-    AddCreatPurchase(&ret, creat_thresh, creat_thresh_time);
+    AddCreatPurchase(&ret, filter, creat_thresh, creat_thresh_time);
     // Branch 2: Save for the next thing.
     if (!creat_must_buy) {
-      ret.push_back(PassTime(creat_thresh_time));
-      ret.back()->creat_ = creat_thresh;
+      if (BasicState *b = AddBranch(&ret, filter, Decision::kSaveCreat,
+                                    creat_thresh_time)) {
+        b->creat_ = Scalar(creat_thresh);
+      }
     }
     return ret;
   }
@@ -435,63 +673,91 @@ State::BranchList State::DoBranches(LimitType limit_type,
   __builtin_trap();
 } // namespace clips
 
-State::BranchList State::Branches(LimitType limit_type,
-                                  double limit_value) const {
-  State::BranchList br = DoBranches(limit_type, limit_value);
+template <typename Scalar, typename Config>
+typename BasicState<Scalar, Config>::BranchList
+BasicState<Scalar, Config>::Branches(LimitType limit_type,
+                                     double limit_value) const {
+  return FilteredBranches(limit_type, limit_value, nullptr);
+}
+
+template <typename Scalar, typename Config>
+typename BasicState<Scalar, Config>::BranchList
+BasicState<Scalar, Config>::Branches(LimitType limit_type, double limit_value,
+                                     BranchFilter filter) const {
+  return FilteredBranches(limit_type, limit_value, &filter);
+}
+
+template <typename Scalar, typename Config>
+typename BasicState<Scalar, Config>::BranchList
+BasicState<Scalar, Config>::FilteredBranches(
+    LimitType limit_type, double limit_value,
+    const BranchFilter *filter) const {
+  BranchList br = DoBranches(limit_type, limit_value, filter);
   for (size_t i = 0; i < br.size(); ++i) {
     if (br[i]->spree_ != kNothing) {
-      br[i]->AddSpreePurchases(&br);
+      br[i]->AddSpreePurchases(&br, filter, br[i]->time_ - time_);
       br[i]->spree_ = kNothing;
     }
   }
   return br;
 }
 
-void State::AddSpreePurchases(BranchList *out) const {
+template <typename Scalar, typename Config>
+void BasicState<Scalar, Config>::AddSpreePurchases(BranchList *out,
+                                                   const BranchFilter *filter,
+                                                   double seconds) const {
+  // Spree purchases are made at this state's own time, which is `seconds`
+  // from the state Branches() was called on.
+  auto accepts = [&](Decision decision, uint32_t bought) {
+    if (filter == nullptr) {
+      return true;
+    }
+    BranchInfo info = Describe(decision, 0., bought, 0);
+    info.seconds = seconds;
+    return (*filter)(info);
+  };
   int hypno_harmonics = (projects_ & kHypnoHarmonics) ? 1 : 0;
-  bool at_thresh = false;
-  switch (spree_) {
-  case kSpreeProcessor:
-    // Buy a processor?
-    if (trust_ > memory_ + processors_ + hypno_harmonics &&
-        processors_ < max_procs) {
-      out->push_back(absl::make_unique<State>(*this));
-      out->back()->processors_ += 1;
-      out->back()->LogProcessor();
-      out->back()->spree_ = kSpreeMemory;
+  // Processors are only bought with freshly earned trust.
+  int rank = instant_rank_;
+  if (spree_ == kSpreeMemory) {
+    rank = std::max<int>(rank, kRankProcessor);
+  }
+  // Buy a processor?
+  if (rank < kRankProcessor &&
+      trust_ > memory_ + processors_ + hypno_harmonics &&
+      processors_ < Config::kMaxProcessors &&
+      accepts(Decision::kBuyProcessor, 0)) {
+    out->push_back(absl::make_unique<BasicState>(*this));
+    out->back()->processors_ += 1;
+    out->back()->LogProcessor();
+    out->back()->instant_rank_ = kRankProcessor;
+  }
+  // Buy memory (to stop collecting creat?)
+  if (rank < kRankMemory && trust_ > memory_ + processors_ + hypno_harmonics &&
+      accepts(Decision::kBuyMemory, 0)) {
+    out->push_back(absl::make_unique<BasicState>(*this));
+    out->back()->memory_ += 1;
+    out->back()->LogMemory();
+    out->back()->instant_rank_ = kRankMemory;
+  }
+  for (int i = 0; i < kNumOpsProjects; ++i) {
+    const auto &item = kOpsProjects[i];
+    // don't buy items we considered in a previous pass
+    if (rank >= kRankFirstOpsProject + i) {
+      continue;
     }
-    ABSL_FALLTHROUGH_INTENDED;
-  case kSpreeMemory:
-    // Buy memory (to stop collecting creat?)
-    if (trust_ > memory_ + processors_ + hypno_harmonics) {
-      out->push_back(absl::make_unique<State>(*this));
-      out->back()->memory_ += 1;
-      out->back()->LogMemory();
-      out->back()->spree_ = kHypnoHarmonics;
-    }
-    at_thresh = true;
-    ABSL_FALLTHROUGH_INTENDED;
-  default:
-    for (int i = 0; i < kNumOpsProjects; ++i) {
-      const auto &item = kOpsProjects[i];
-      // don't buy items we considered in a previous pass
-      if (item.project == spree_) {
-        at_thresh = true;
-      }
-      if (!at_thresh) {
-        continue;
-      }
-      if (ops_ >= item.cost && MeetsPrereqs(item.project)) {
-        out->push_back(absl::make_unique<State>(*this));
-        out->back()->AwardProject(item.project);
-        out->back()->ops_ -= item.cost;
-        out->back()->spree_ = item.next_project;
-      }
+    if (ops_ >= item.cost && MeetsPrereqs(item.project) &&
+        accepts(Decision::kBuyOpsProject, item.project)) {
+      out->push_back(absl::make_unique<BasicState>(*this));
+      out->back()->AwardProject(item.project);
+      out->back()->ops_ -= Scalar(item.cost);
+      out->back()->instant_rank_ = kRankFirstOpsProject + i;
     }
   }
 }
 
-void State::AwardProject(uint32_t proj) {
+template <typename Scalar, typename Config>
+void BasicState<Scalar, Config>::AwardProject(uint32_t proj) {
   uint32_t project_keys[19] = {
       kImprovedAutoclippers,
       kCreativity,
@@ -523,19 +789,33 @@ void State::AwardProject(uint32_t proj) {
   assert(!"WAAA");
 }
 
-void State::Log(uint8_t v) {
+template <typename Scalar, typename Config>
+void BasicState<Scalar, Config>::Log(uint8_t v) {
   if (history_idx_ < kHistorySize) {
     history_[history_idx_++] = v;
   }
 }
 
-void State::LogMlvl() { Log(std::min<int>(127, auto_clippers_)); }
-void State::LogProcessor() { Log(128); }
-void State::LogMemory() { Log(129); }
+template <typename Scalar, typename Config>
+void BasicState<Scalar, Config>::LogMlvl() {
+  Log(std::min<int>(127, auto_clippers_));
+}
+template <typename Scalar, typename Config>
+void BasicState<Scalar, Config>::LogProcessor() {
+  Log(128);
+}
+template <typename Scalar, typename Config>
+void BasicState<Scalar, Config>::LogMemory() {
+  Log(129);
+}
 // purchases use log IDs 130 through 148 inclusive
-void State::LogPurchase(uint8_t id) { Log(130 + id); }
+template <typename Scalar, typename Config>
+void BasicState<Scalar, Config>::LogPurchase(uint8_t id) {
+  Log(130 + id);
+}
 
-std::ostream &operator<<(std::ostream &o, const State &s) {
+template <typename Scalar, typename Config>
+std::ostream &operator<<(std::ostream &o, const BasicState<Scalar, Config> &s) {
   int minutes = floor(s.time_ / 60);
   double seconds = s.time_ - 60. * minutes;
   int hypno_harmonics = (s.projects_ & s.kHypnoHarmonics) ? 1 : 0;
@@ -544,7 +824,7 @@ std::ostream &operator<<(std::ostream &o, const State &s) {
       "ops=%05d "
       "cre=%03d cp=%06d ",
       minutes, seconds, s.trust_ - hypno_harmonics, s.memory_, s.processors_,
-      s.auto_clippers_, s.mlvl_, s.dollars_, int(s.ops_), int(s.creat_),
+      s.auto_clippers_, s.mlvl_, double(s.dollars_), int(s.ops_), int(s.creat_),
       int(s.clips_));
   for (int mask = 0x00001; mask <= 0x200000; mask <<= 1) {
     if (s.projects_ & mask) {
@@ -562,15 +842,18 @@ std::ostream &operator<<(std::ostream &o, const State &s) {
   return o << "\n";
 }
 
-std::string State::Detail() const {
+template <typename Scalar, typename Config>
+std::string BasicState<Scalar, Config>::Detail() const {
   return absl::StrFormat("     t=%f o=%f cr=%f cl=%f $=%f\n"
                          "     o/t=%f cr/t=%f cl/t=%f $/t=%f\n",
-                         time_, ops_, creat_, clips_, dollars_,
+                         double(time_), double(ops_), double(creat_),
+                         double(clips_), double(dollars_),
                          OpsPerSecond() / 100., CreatPerSecond() / 100.,
                          ClipsPerSecond() / 100., DollarsPerSecond() / 100.);
 }
 
-std::string State::History() const {
+template <typename Scalar, typename Config>
+std::string BasicState<Scalar, Config>::History() const {
   std::vector<int> h;
   for (int i = 0; i < history_idx_; ++i) {
     h.push_back(history_[i]);
@@ -578,4 +861,12 @@ std::string State::History() const {
   return absl::StrJoin(h, " ");
 }
 
+template class BasicState<double>;
+template class BasicState<Fixed>;
+template class BasicState<double, SevenProcessorConfig>;
+template std::ostream &operator<<(std::ostream &o, const State &s);
+template std::ostream &operator<<(std::ostream &o, const FixedState &s);
+template std::ostream &operator<<(std::ostream &o,
+                                  const SevenProcessorState &s);
+
 } // namespace clips
\ No newline at end of file
@@ -2,44 +2,134 @@
 #define CLIPS_CLIPS_H_
 
 #include <algorithm>
+#include <array>
 #include <cmath>
+#include <cstddef>
 #include <cstdint>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 #include "absl/container/inlined_vector.h"
+#include "absl/functional/function_ref.h"
+#include "fixed.h"
+#include "memory.h"
 
 namespace clips {
 
+// Fill a table at compile time with f(0), f(1), ..., f(N - 1).
+template <size_t N, typename F>
+constexpr std::array<decltype(std::declval<F>()(0)), N> MakeTable(F f) {
+  std::array<decltype(std::declval<F>()(0)), N> table = {};
+  for (size_t i = 0; i < N; ++i) {
+    table[i] = f(i);
+  }
+  return table;
+}
+
+// <cmath> isn't constexpr, so tables that need logs and powers use these.
+constexpr double ConstexprLog(double x) {
+  // Scale into [0.75, 1.5], then ln(x) = 2 atanh((x - 1) / (x + 1)).
+  constexpr double ln2 = 0.6931471805599453;
+  double result = 0.;
+  for (; x > 1.5; x /= 2.) {
+    result += ln2;
+  }
+  for (; x < 0.75; x *= 2.) {
+    result -= ln2;
+  }
+  const double z = (x - 1.) / (x + 1.);
+  double term = z;
+  for (int i = 1; i < 60; i += 2) {
+    result += 2. * term / i;
+    term *= z * z;
+  }
+  return result;
+}
+
+constexpr double ConstexprExp(double x) {
+  // Halve into [-0.5, 0.5], sum the Taylor series, and square back up.
+  int halvings = 0;
+  for (; x > 0.5 || x < -0.5; x /= 2.) {
+    ++halvings;
+  }
+  double result = 1.;
+  double term = 1.;
+  for (int i = 1; i < 25; ++i) {
+    term *= x / i;
+    result += term;
+  }
+  for (; halvings > 0; --halvings) {
+    result *= result;
+  }
+  return result;
+}
+
 constexpr double CalculateOnePointOneToNth(int n) {
   return (n <= 0) ? 1.0 : 1.1 * CalculateOnePointOneToNth(n - 1);
 }
 
-constexpr double one_point_one_to_nth[] = {
-    CalculateOnePointOneToNth(0),  CalculateOnePointOneToNth(1),
-    CalculateOnePointOneToNth(2),  CalculateOnePointOneToNth(3),
-    CalculateOnePointOneToNth(4),  CalculateOnePointOneToNth(5),
-    CalculateOnePointOneToNth(6),  CalculateOnePointOneToNth(7),
-    CalculateOnePointOneToNth(8),  CalculateOnePointOneToNth(9),
-    CalculateOnePointOneToNth(10), CalculateOnePointOneToNth(11),
-    CalculateOnePointOneToNth(12), CalculateOnePointOneToNth(13),
-    CalculateOnePointOneToNth(14), CalculateOnePointOneToNth(15),
-    CalculateOnePointOneToNth(16), CalculateOnePointOneToNth(17),
-    CalculateOnePointOneToNth(18), CalculateOnePointOneToNth(19),
-    CalculateOnePointOneToNth(20), CalculateOnePointOneToNth(21),
-    CalculateOnePointOneToNth(22), CalculateOnePointOneToNth(23),
-    CalculateOnePointOneToNth(24), CalculateOnePointOneToNth(25),
-    CalculateOnePointOneToNth(26), CalculateOnePointOneToNth(27),
-    CalculateOnePointOneToNth(28), CalculateOnePointOneToNth(29),
-    CalculateOnePointOneToNth(30), CalculateOnePointOneToNth(31),
-    CalculateOnePointOneToNth(32), CalculateOnePointOneToNth(33),
-    CalculateOnePointOneToNth(34), CalculateOnePointOneToNth(35),
-    CalculateOnePointOneToNth(36), CalculateOnePointOneToNth(37),
-    CalculateOnePointOneToNth(38), CalculateOnePointOneToNth(39),
-};
+constexpr auto one_point_one_to_nth = MakeTable<40>(CalculateOnePointOneToNth);
 
 constexpr double OnePointOneToNth(int n) { return one_point_one_to_nth[n]; }
 
-class State {
+// Seconds to earn one creat.  The game's creativity speed is
+// log10(p) * p^1.1 + p - 1 (at least 1) for p processors, and a creat is
+// earned every ceil(400 / speed) ticks of 10ms.
+constexpr double CalculateSecondsPerCreat(int processors) {
+  const int p = std::max(processors, 1);
+  const double log_p = ConstexprLog(p);
+  double speed =
+      log_p / ConstexprLog(10.) * ConstexprExp(1.1 * log_p) + p - 1.;
+  if (speed < 1.) {
+    speed = 1.;
+  }
+  const double ticks = 400. / speed;
+  int whole_ticks = static_cast<int>(ticks);
+  if (whole_ticks < ticks) {
+    ++whole_ticks;
+  }
+  return whole_ticks / 100.;
+}
+
+// The game rules a State is compiled against.  For a parameter study,
+// derive a struct from DefaultConfig, shadow the members that change, and
+// instantiate BasicState with it at the end of clips.cpp.
+struct DefaultConfig {
+  // Processors and memory are never bought past these.
+  static constexpr int kMaxProcessors = 6;
+  static constexpr int kMaxMemory = 10;
+  // Clip counts that are decision points: operations come online at the
+  // first, and each one after that earns a trust.
+  static constexpr double kClipsThresholds[] = {
+      2000., 3000., 5000., 8000., 13000., 21000., 34000., 55000., 89000.,
+      144000.};
+};
+
+// The variant the game's lookup tables used to stop at.
+struct SevenProcessorConfig : DefaultConfig {
+  static constexpr int kMaxProcessors = 7;
+};
+
+// Grid sizes for approximate dominance, per resource.  A size of zero
+// compares that resource exactly.
+struct Tolerance {
+  double time = 0.;
+  double dollars = 0.;
+  double ops = 0.;
+  double creat = 0.;
+  double clips = 0.;
+};
+
+class PackedBin;
+
+// A game state.  Time and resources are stored as `Scalar`: double, or
+// Fixed for exact comparison and hashing.  Rates are computed in double
+// either way.  `Config` fixes the rules, as above.
+template <typename Scalar, typename Config = DefaultConfig> class BasicState {
 public:
   enum {
     kNothing = 0,
@@ -73,16 +163,29 @@ public:
     kWin = 0x200000,
   };
 
-  State() = default;
-  State(const State &) = default;
-  State(State &&) = default;
-  State &operator=(const State &) = default;
-  State &operator=(State &&) = default;
+  BasicState() = default;
+  BasicState(const BasicState &) = default;
+  BasicState(BasicState &&) = default;
+  BasicState &operator=(const BasicState &) = default;
+  BasicState &operator=(BasicState &&) = default;
 
-  using BranchList = absl::InlinedVector<std::unique_ptr<State>, 4>;
+  // Heap states, and BranchList buffers, are counted in the memory totals.
+  static void *operator new(size_t size) {
+    CountMemory(MemoryKind::kStates, size);
+    return ::operator new(size);
+  }
+  static void operator delete(void *p, size_t size) {
+    CountMemory(MemoryKind::kStates, -static_cast<int64_t>(size));
+    ::operator delete(p);
+  }
+
+  using BranchList = absl::InlinedVector<
+      std::unique_ptr<BasicState>, 4,
+      CountingAllocator<std::unique_ptr<BasicState>,
+                        MemoryKind::kBranchLists>>;
 
   // Return a copy of this state, after the given amount of time passes.
-  std::unique_ptr<State> PassTime(double seconds) const;
+  std::unique_ptr<BasicState> PassTime(double seconds) const;
 
   enum LimitType {
     kClipsLimit,
@@ -93,6 +196,64 @@ public:
   BranchList Branches(LimitType limit_type = kTimeLimit,
                       double limit_value = HUGE_VAL) const;
 
+  // The decision that leads to a branch.
+  enum class Decision {
+    kReachLimit,
+    kWin,
+    kOpsOnline,
+    kBuyAutoclipper,
+    kBuyMarketing,
+    kSaveDollars,
+    kBuyProcessor,
+    kBuyMemory,
+    kSaveTrust,
+    kBuyOpsProject,
+    kSaveOps,
+    kBuyCreatProject,
+    kSaveCreat,
+  };
+
+  // What is known about a branch before it is built: the decision, how many
+  // seconds from this state it is made, and what the branch will hold.  Only
+  // valid during the call to the filter it is passed to.
+  class BranchInfo {
+  public:
+    Decision decision;
+    double seconds;
+
+    // The resources as they stand once the time has passed, before the
+    // decision spends any of them, so they bound the branch's own from
+    // above.  They are worked out when asked for, so a filter that only
+    // looks at the time doesn't pay for them.
+    double Ops() const;
+    double Creat() const;
+    double Clips() const;
+    double Dollars() const;
+
+    // Including what the decision earns and buys.
+    int Trust() const { return from_->trust_ + trust_earned_; }
+    uint32_t Projects() const { return from_->projects_ | bought_; }
+
+  private:
+    friend class BasicState;
+
+    const BasicState *from_;
+    // How far past `from_` the resources are projected.  A spree purchase is
+    // described from the state that makes it, so this is 0 for those.
+    double elapsed_;
+    uint32_t bought_;
+    int trust_earned_;
+  };
+  using BranchFilter = absl::FunctionRef<bool(const BranchInfo &)>;
+
+  // As above, but each branch is described to `filter` before it is built,
+  // and the branches it rejects are never copied.  The one exception is a
+  // creativity purchase: the purchases made at the same instant after it are
+  // branches of their own, described on their own, so it is still built to
+  // make them from.
+  BranchList Branches(LimitType limit_type, double limit_value,
+                      BranchFilter filter) const;
+
   bool AtGoal(LimitType limit_type, double limit_value) const {
     switch (limit_type) {
     case kClipsLimit:
@@ -104,12 +265,22 @@ public:
     return false;
   }
 
-  bool IsStrictlyWorseThan(const State &other) const;
+  bool IsStrictlyWorseThan(const BasicState &other) const;
+
+  // True if this state is strictly worse than `other` once every resource
+  // is snapped down to a multiple of its tolerance.  A state rejected this
+  // way trails `other` by less than one grid step in each resource.
+  bool IsApproximatelyWorseThan(const BasicState &other,
+                                const Tolerance &tol) const;
 
-  friend std::ostream &operator<<(std::ostream &o, const State &s);
+  template <typename S, typename C>
+  friend std::ostream &operator<<(std::ostream &o, const BasicState<S, C> &s);
 
   double Time() const { return time_; }
   double Clips() const { return clips_; }
+  double Ops() const { return ops_; }
+  double Creat() const { return creat_; }
+  double Dollars() const { return dollars_; }
   bool Win() const { return projects_ & kWin; }
 
   // A state-based key.  Two states in different bins can't be strictly worse
@@ -118,8 +289,18 @@ public:
   BinType Bin() const {
     return std::make_tuple(processors_, memory_, auto_clippers_, mlvl_);
   }
+  // A finer key within a bin: the project mask.  A state can only be
+  // strictly worse than a state in its bin whose SubBin() is a superset of
+  // its own, or one that has won.
+  using SubBinType = uint32_t;
+  SubBinType SubBin() const { return projects_; }
   static constexpr double eps = 1e-9;
 
+  // A hash of every field that affects how the game goes from here, for
+  // looking states up in tables kept on disk.  The purchase log is left
+  // out, so states reached by different lines of play can share one.
+  uint64_t Fingerprint() const;
+
 private:
   // clips multiplier based on active projects
   double ClipBoost() const {
@@ -191,16 +372,27 @@ public:
     if (ops_ < memory_ * 1000. || !(projects_ & kCreativity)) {
       return 0.;
     }
-    static const double seconds_per_creat[] = {4., 4., 2.44, 1.12,
-                                               .7, .5, .38,  .31};
     // small fudge factor, to avoid ties
-    return 1. / seconds_per_creat[processors_] + 3e-8;
+    return 1. / kSecondsPerCreat[processors_] + 3e-8;
   }
 
   std::string History() const;
   std::string Detail() const;
 
+  // Seconds to earn a creat, indexed by processor count.
+  static constexpr auto kSecondsPerCreat =
+      MakeTable<Config::kMaxProcessors + 1>(CalculateSecondsPerCreat);
+
+  // The purchase log that History() prints.  Only the first kHistorySize
+  // purchases are logged.
+  static constexpr uint8_t kHistorySize = 47;
+  int HistorySize() const { return history_idx_; }
+  const uint8_t *HistoryBegin() const { return history_; }
+
 private:
+  // Packs and unpacks states field by field.
+  friend class PackedBin;
+
   // Returns true if you meet the criteria to purchase the given project.
   // Does not check if costs can be paid.  Returns false if the project is
   // already purchased.
@@ -210,10 +402,10 @@ private:
   double NextOpsLimit() const;
 
   // Add all purchases possible for this threshold
-  void AddOpsPurchases(BranchList *br, double ops_thresh,
-                       double ops_thresh_time) const;
-  void AddCreatPurchase(BranchList *br, double creat_thresh,
-                        double creat_thresh_time) const;
+  void AddOpsPurchases(BranchList *br, const BranchFilter *filter,
+                       double ops_thresh, double ops_thresh_time) const;
+  void AddCreatPurchase(BranchList *br, const BranchFilter *filter,
+                        double creat_thresh, double creat_thresh_time) const;
 
   // Returns the next limit for buying a creativity project.  The attached
   // boolean is true if this is a "must buy" price, the highest remaining
@@ -222,16 +414,59 @@ private:
 
   void AwardProject(uint32_t project);
 
-  BranchList DoBranches(LimitType limit_type = kTimeLimit,
-                        double limit_value = HUGE_VAL) const;
+  // Describe a branch `seconds` from now that buys the projects `bought`
+  // and earns `trust_earned`.
+  BranchInfo Describe(Decision decision, double seconds, uint32_t bought,
+                      int trust_earned) const;
+
+  // A null filter accepts every branch, without it being described.
+  bool Accepts(const BranchFilter *filter, Decision decision, double seconds,
+               uint32_t bought = 0, int trust_earned = 0) const {
+    return filter == nullptr ||
+           (*filter)(Describe(decision, seconds, bought, trust_earned));
+  }
+
+  // Append the state `seconds` from now to the branch list, unless `filter`
+  // rejects it.  Returns the new branch, or nullptr if it was rejected.
+  // `bought` and `trust_earned` are only for describing it to the filter.
+  BasicState *AddBranch(BranchList *br, const BranchFilter *filter,
+                        Decision decision, double seconds,
+                        uint32_t bought = 0, int trust_earned = 0) const;
+
+  // A null filter accepts every branch.
+  BranchList FilteredBranches(LimitType limit_type, double limit_value,
+                              const BranchFilter *filter) const;
+  BranchList DoBranches(LimitType limit_type, double limit_value,
+                        const BranchFilter *filter) const;
+
+  // Purchases made at the same instant commute, so they are only generated
+  // in increasing rank order.  Each state records the rank of the last
+  // purchase made at its current time (or declined, when a branch saves past
+  // a cheaper item); passing time resets it.
+  enum PurchaseRank : uint8_t {
+    kRankNone = 0,
+    kRankAutoclipper,
+    kRankMarketing,
+    kRankProcessor,
+    kRankMemory,
+    // Ops projects follow, in kOpsProjects order.
+    kRankFirstOpsProject,
+  };
+
+  // True if a purchase of the given rank may be made `seconds` from now.
+  bool CanPurchaseAfter(double seconds, int rank) const {
+    return seconds > 0. || rank > instant_rank_;
+  }
 
   // Make all spree purchases possible from this state, and append them to
   // the branch list.
   //
   // It is assumed that *this is a member of the BranchList.  This is only
   // safe because the list is a container of unique_ptrs, so *this won't
-  // be moved if the container grows.
-  void AddSpreePurchases(BranchList *out) const;
+  // be moved if the container grows.  `seconds` is how far *this is from the
+  // state Branches() was called on, for the filter's benefit.
+  void AddSpreePurchases(BranchList *out, const BranchFilter *filter,
+                         double seconds) const;
 
   // Logging functions
   void Log(uint8_t v);
@@ -240,11 +475,11 @@ private:
   void LogMemory();
   void LogPurchase(uint8_t id);
 
-  double time_ = 0.;
-  double ops_ = 0.;
-  double creat_ = 0.;
-  double clips_ = 0.;
-  double dollars_ = 0.;
+  Scalar time_ = Scalar(0.);
+  Scalar ops_ = Scalar(0.);
+  Scalar creat_ = Scalar(0.);
+  Scalar clips_ = Scalar(0.);
+  Scalar dollars_ = Scalar(0.);
 
   int trust_ = 2;
   int processors_ = 1;
@@ -254,11 +489,25 @@ private:
 
   uint32_t projects_ = 0;
   uint32_t spree_ = kNothing;
-  static constexpr uint8_t kHistorySize = 47;
+  uint8_t instant_rank_ = kRankNone;
   uint8_t history_idx_ = 0;
   uint8_t history_[kHistorySize] = {0};
 };
 
+template <typename Scalar, typename Config>
+std::ostream &operator<<(std::ostream &o, const BasicState<Scalar, Config> &s);
+
+// These variants are instantiated in clips.cpp.
+extern template class BasicState<double>;
+extern template class BasicState<Fixed>;
+extern template class BasicState<double, SevenProcessorConfig>;
+
+using State = BasicState<double>;
+using FixedState = BasicState<Fixed>;
+using SevenProcessorState = BasicState<double, SevenProcessorConfig>;
+
+using StateVec = std::vector<std::unique_ptr<State>>;
+
 } // namespace clips
 
 #endif // CLIPS_CLIPS_H_
\ No newline at end of file
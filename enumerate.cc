@@ -0,0 +1,206 @@
+#include "enumerate.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "absl/memory/memory.h"
+
+namespace clips {
+
+namespace {
+
+// Unexpanded subtrees belonging to one worker.  The owner pushes and pops at
+// the back, so its own walk stays depth-first; thieves take from the front,
+// where the states closest to the root (and so the largest subtrees) are.
+class WorkDeque {
+public:
+  void Push(std::unique_ptr<State> state) {
+    std::lock_guard<std::mutex> lock(mu_);
+    items_.push_back(std::move(state));
+  }
+
+  std::unique_ptr<State> Pop() {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (items_.empty()) {
+      return nullptr;
+    }
+    std::unique_ptr<State> ret = std::move(items_.back());
+    items_.pop_back();
+    return ret;
+  }
+
+  std::unique_ptr<State> Steal() {
+    std::unique_lock<std::mutex> lock(mu_, std::try_to_lock);
+    if (!lock.owns_lock() || items_.empty()) {
+      return nullptr;
+    }
+    std::unique_ptr<State> ret = std::move(items_.front());
+    items_.pop_front();
+    return ret;
+  }
+
+private:
+  std::mutex mu_;
+  std::deque<std::unique_ptr<State>> items_;
+};
+
+// If `keep_all` is set, every goal state is returned, not just the Pareto
+// set.
+class Enumerator {
+public:
+  Enumerator(State::LimitType limit_type, double limit_value, int num_threads,
+             bool keep_all)
+      : limit_type_(limit_type), limit_value_(limit_value),
+        keep_all_(keep_all), deques_(num_threads), results_(num_threads),
+        all_(num_threads) {}
+
+  StateVec Run(StateVec roots) {
+    const int num_threads = deques_.size();
+    int next_deque = 0;
+    for (auto &root : roots) {
+      if (root->AtGoal(limit_type_, limit_value_)) {
+        AddGoal(0, std::move(root));
+      } else {
+        pending_.fetch_add(1);
+        deques_[(next_deque++) % num_threads].Push(std::move(root));
+      }
+    }
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i) {
+      threads.emplace_back([this, i]() { Work(i); });
+    }
+    for (std::thread &t : threads) {
+      t.join();
+    }
+    if (keep_all_) {
+      StateVec ret;
+      for (StateVec &part : all_) {
+        for (auto &s : part) {
+          ret.push_back(std::move(s));
+        }
+      }
+      SortByTime(ret, num_threads);
+      return ret;
+    }
+    return ParetoSet::MergeAll(std::move(results_), num_threads)
+        .TakeSorted(num_threads);
+  }
+
+private:
+  void AddGoal(int self, std::unique_ptr<State> state) {
+    if (keep_all_) {
+      all_[self].push_back(std::move(state));
+    } else {
+      results_[self].Insert(std::move(state));
+    }
+  }
+
+  std::unique_ptr<State> FindWork(int self) {
+    std::unique_ptr<State> ret = deques_[self].Pop();
+    const int num_threads = deques_.size();
+    for (int i = 1; !ret && i < num_threads; ++i) {
+      ret = deques_[(self + i) % num_threads].Steal();
+    }
+    return ret;
+  }
+
+  void Work(int self) {
+    while (true) {
+      std::unique_ptr<State> cur = FindWork(self);
+      if (!cur) {
+        if (pending_.load() == 0) {
+          return;
+        }
+        std::this_thread::yield();
+        continue;
+      }
+      for (auto &next : cur->Branches(limit_type_, limit_value_)) {
+        if (next->AtGoal(limit_type_, limit_value_)) {
+          AddGoal(self, std::move(next));
+        } else {
+          // Count the child before retiring its parent, so pending_ can't
+          // touch zero while work remains.
+          pending_.fetch_add(1);
+          deques_[self].Push(std::move(next));
+        }
+      }
+      pending_.fetch_sub(1);
+    }
+  }
+
+  const State::LimitType limit_type_;
+  const double limit_value_;
+  const bool keep_all_;
+  // Number of states pushed to a deque but not yet fully expanded.
+  std::atomic<int64_t> pending_{0};
+  std::vector<WorkDeque> deques_;
+  std::vector<ParetoSet> results_;
+  std::vector<StateVec> all_;
+};
+
+int ThreadsOrDefault(int num_threads) {
+  return num_threads > 0 ? num_threads
+                         : std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Copies of the members of `states` that aren't strictly worse than another
+// member, sorted by time.
+StateVec ParetoCopies(const StateVec &states, int num_threads) {
+  std::vector<ParetoSet> sets(num_threads);
+  std::vector<std::thread> threads;
+  for (int w = 0; w < num_threads; ++w) {
+    threads.emplace_back([&states, &sets, num_threads, w]() {
+      for (size_t i = w; i < states.size(); i += num_threads) {
+        sets[w].Insert(absl::make_unique<State>(*states[i]));
+      }
+    });
+  }
+  for (std::thread &t : threads) {
+    t.join();
+  }
+  return ParetoSet::MergeAll(std::move(sets), num_threads)
+      .TakeSorted(num_threads);
+}
+
+} // namespace
+
+StateVec EnumerateToLimit(const State &start, State::LimitType limit_type,
+                          double limit_value, int num_threads) {
+  StateVec roots;
+  roots.push_back(absl::make_unique<State>(start));
+  return EnumerateToLimit(std::move(roots), limit_type, limit_value,
+                          num_threads);
+}
+
+StateVec EnumerateToLimit(StateVec roots, State::LimitType limit_type,
+                          double limit_value, int num_threads) {
+  num_threads = ThreadsOrDefault(num_threads);
+  Enumerator enumerator(limit_type, limit_value, num_threads,
+                        /*keep_all=*/false);
+  return enumerator.Run(std::move(roots));
+}
+
+void SweepToLimits(const State &start, State::LimitType limit_type,
+                   const std::vector<double> &goal_values,
+                   const SweepCallback &callback, int num_threads) {
+  assert(std::is_sorted(goal_values.begin(), goal_values.end()));
+  num_threads = ThreadsOrDefault(num_threads);
+  StateVec frontier;
+  frontier.push_back(absl::make_unique<State>(start));
+  for (double goal_value : goal_values) {
+    Enumerator enumerator(limit_type, goal_value, num_threads,
+                          /*keep_all=*/true);
+    frontier = enumerator.Run(std::move(frontier));
+    callback(goal_value, ParetoCopies(frontier, num_threads));
+    if (frontier.empty()) {
+      // Every branch died out; later goals are unreachable too.
+      break;
+    }
+  }
+}
+
+} // namespace clips
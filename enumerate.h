@@ -0,0 +1,44 @@
+#ifndef CLIPS_ENUMERATE_H_
+#define CLIPS_ENUMERATE_H_
+
+#include <functional>
+#include <vector>
+
+#include "clips.h"
+#include "pareto.h"
+
+namespace clips {
+
+// Expand every branch from `start` until it reaches the given goal, and
+// return the goal states that aren't strictly worse than any other goal
+// state, sorted by time.
+//
+// The search tree is walked depth-first by `num_threads` workers (0 means one
+// per hardware thread).  Each worker owns a deque of unexpanded subtrees, and
+// idle workers steal the oldest (shallowest) subtree from a busy one.  Goal
+// states are collected into a ParetoSet per worker, and the sets are merged
+// in parallel when the walk is done.
+StateVec EnumerateToLimit(const State &start, State::LimitType limit_type,
+                          double limit_value, int num_threads = 0);
+
+// As above, but expanding from several start states at once.
+StateVec EnumerateToLimit(StateVec roots, State::LimitType limit_type,
+                          double limit_value, int num_threads = 0);
+
+// Called by SweepToLimits() with each goal value, and the goal states for it.
+using SweepCallback = std::function<void(double goal_value, const StateVec &)>;
+
+// Solve for each of an ascending list of goal values in one pass.
+//
+// Every goal state for one value is used as a root for the next value, so
+// the tree leading up to the first goal is only expanded once.  `callback`
+// gets the same states EnumerateToLimit() would return for the value.  No
+// state is dropped from the roots for being strictly worse than another,
+// since that test ignores trust.
+void SweepToLimits(const State &start, State::LimitType limit_type,
+                   const std::vector<double> &goal_values,
+                   const SweepCallback &callback, int num_threads = 0);
+
+} // namespace clips
+
+#endif // CLIPS_ENUMERATE_H_
@@ -0,0 +1,61 @@
+#ifndef CLIPS_FIXED_H_
+#define CLIPS_FIXED_H_
+
+#include <cmath>
+#include <cstdint>
+#include <utility>
+
+namespace clips {
+
+// A resource amount stored as a whole number of millionths.
+//
+// Fixed converts to double implicitly, so rate formulas read the same for
+// either representation.  Converting a double to Fixed must be spelled out,
+// and rounds to the nearest unit.  Comparisons, sums and differences of two
+// Fixed values are exact.
+class Fixed {
+public:
+  static constexpr int64_t kScale = 1000000;
+
+  constexpr Fixed() = default;
+  explicit Fixed(double value) : raw_(std::llround(value * kScale)) {}
+
+  static constexpr Fixed FromRaw(int64_t raw) {
+    Fixed f;
+    f.raw_ = raw;
+    return f;
+  }
+  constexpr int64_t raw() const { return raw_; }
+
+  // Division (rather than multiplying by 1e-6) keeps whole values exact.
+  operator double() const { return double(raw_) / kScale; }
+
+  Fixed &operator+=(Fixed other) {
+    raw_ += other.raw_;
+    return *this;
+  }
+  Fixed &operator-=(Fixed other) {
+    raw_ -= other.raw_;
+    return *this;
+  }
+  friend Fixed operator+(Fixed a, Fixed b) { return a += b; }
+  friend Fixed operator-(Fixed a, Fixed b) { return a -= b; }
+
+  friend bool operator==(Fixed a, Fixed b) { return a.raw_ == b.raw_; }
+  friend bool operator!=(Fixed a, Fixed b) { return a.raw_ != b.raw_; }
+  friend bool operator<(Fixed a, Fixed b) { return a.raw_ < b.raw_; }
+  friend bool operator>(Fixed a, Fixed b) { return a.raw_ > b.raw_; }
+  friend bool operator<=(Fixed a, Fixed b) { return a.raw_ <= b.raw_; }
+  friend bool operator>=(Fixed a, Fixed b) { return a.raw_ >= b.raw_; }
+
+  template <typename H> friend H AbslHashValue(H h, Fixed f) {
+    return H::combine(std::move(h), f.raw_);
+  }
+
+private:
+  int64_t raw_ = 0;
+};
+
+} // namespace clips
+
+#endif // CLIPS_FIXED_H_
@@ -0,0 +1,288 @@
+#include "frontier.h"
+
+#include <cassert>
+#include <cstring>
+#include <tuple>
+
+#include "pareto.h"
+
+namespace clips {
+
+namespace {
+
+void PutVarint(uint64_t v, PackedBin::Data *out) {
+  while (v >= 0x80) {
+    out->push_back(static_cast<char>(v | 0x80));
+    v >>= 7;
+  }
+  out->push_back(static_cast<char>(v));
+}
+
+// The Get functions read from `p` up to `end`, and return false if the
+// data runs out or is malformed.
+bool GetVarint(const char *&p, const char *end, uint64_t *v) {
+  *v = 0;
+  for (int shift = 0; shift < 64 && p < end; shift += 7) {
+    const uint8_t byte = *p++;
+    *v |= uint64_t(byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool GetByte(const char *&p, const char *end, uint8_t *v) {
+  if (p == end) {
+    return false;
+  }
+  *v = *p++;
+  return true;
+}
+
+uint64_t ZigZag(int64_t v) { return (uint64_t(v) << 1) ^ uint64_t(v >> 63); }
+int64_t UnZigZag(uint64_t v) { return int64_t(v >> 1) ^ -int64_t(v & 1); }
+
+uint64_t Bits(double d) {
+  uint64_t bits;
+  memcpy(&bits, &d, sizeof(bits));
+  return bits;
+}
+
+double FromBits(uint64_t bits) {
+  double d;
+  memcpy(&d, &bits, sizeof(d));
+  return d;
+}
+
+// Store the bytes of `x` between its leading and trailing zero bytes, after
+// a byte holding how many of each there are.  Resources that didn't change
+// take one byte; ones that changed a little share their sign, exponent and
+// high mantissa bits with the previous state, and lose those bytes.
+void PutXor(uint64_t x, PackedBin::Data *out) {
+  if (x == 0) {
+    out->push_back(static_cast<char>(8 << 4));
+    return;
+  }
+  const int lead = __builtin_clzll(x) / 8;
+  const int trail = __builtin_ctzll(x) / 8;
+  out->push_back(static_cast<char>(lead << 4 | trail));
+  for (int i = trail; i < 8 - lead; ++i) {
+    out->push_back(static_cast<char>(x >> (8 * i)));
+  }
+}
+
+bool GetXor(const char *&p, const char *end, uint64_t *x) {
+  uint8_t control;
+  if (!GetByte(p, end, &control)) {
+    return false;
+  }
+  const int lead = control >> 4;
+  const int trail = control & 0xf;
+  if (lead + trail > 8 || end - p < 8 - lead - trail) {
+    return false;
+  }
+  *x = 0;
+  for (int i = trail; i < 8 - lead; ++i) {
+    *x |= uint64_t(uint8_t(*p++)) << (8 * i);
+  }
+  return true;
+}
+
+// Written raw by AppendTo(), so it is zeroed first to keep its padding from
+// going out uninitialized.
+struct PackedHeader {
+  int32_t bin[4];
+  uint32_t size;
+  uint64_t bytes;
+};
+
+} // namespace
+
+State PackedBin::BinTemplate(const State::BinType &bin) {
+  State s;
+  std::tie(s.processors_, s.memory_, s.auto_clippers_, s.mlvl_) = bin;
+  return s;
+}
+
+void PackedBin::Encode(const State &prev, const State &s, Data *out) {
+  // Times are sorted, so this delta is small and never wraps.
+  PutVarint(Bits(s.time_) - Bits(prev.time_), out);
+  PutXor(Bits(s.ops_) ^ Bits(prev.ops_), out);
+  PutXor(Bits(s.creat_) ^ Bits(prev.creat_), out);
+  PutXor(Bits(s.clips_) ^ Bits(prev.clips_), out);
+  PutXor(Bits(s.dollars_) ^ Bits(prev.dollars_), out);
+  PutVarint(ZigZag(s.trust_ - prev.trust_), out);
+  PutVarint(s.projects_ ^ prev.projects_, out);
+  PutVarint(s.spree_, out);
+  out->push_back(static_cast<char>(s.instant_rank_));
+  int common = 0;
+  while (common < s.history_idx_ && common < prev.history_idx_ &&
+         s.history_[common] == prev.history_[common]) {
+    ++common;
+  }
+  out->push_back(static_cast<char>(common));
+  out->push_back(static_cast<char>(s.history_idx_));
+  out->append(reinterpret_cast<const char *>(s.history_ + common),
+              s.history_idx_ - common);
+}
+
+bool PackedBin::Decode(const char *&p, const char *end, State *s) {
+  uint64_t time_delta, ops, creat, clips, dollars, trust, projects, spree;
+  uint8_t instant_rank, common, history_idx;
+  if (!GetVarint(p, end, &time_delta) || !GetXor(p, end, &ops) ||
+      !GetXor(p, end, &creat) || !GetXor(p, end, &clips) ||
+      !GetXor(p, end, &dollars) || !GetVarint(p, end, &trust) ||
+      !GetVarint(p, end, &projects) || !GetVarint(p, end, &spree) ||
+      !GetByte(p, end, &instant_rank) || !GetByte(p, end, &common) ||
+      !GetByte(p, end, &history_idx) || common > s->history_idx_ ||
+      common > history_idx || history_idx > State::kHistorySize ||
+      end - p < history_idx - common) {
+    return false;
+  }
+  s->time_ = FromBits(Bits(s->time_) + time_delta);
+  s->ops_ = FromBits(Bits(s->ops_) ^ ops);
+  s->creat_ = FromBits(Bits(s->creat_) ^ creat);
+  s->clips_ = FromBits(Bits(s->clips_) ^ clips);
+  s->dollars_ = FromBits(Bits(s->dollars_) ^ dollars);
+  s->trust_ += UnZigZag(trust);
+  s->projects_ ^= projects;
+  s->spree_ = spree;
+  s->instant_rank_ = instant_rank;
+  memcpy(s->history_ + common, p, history_idx - common);
+  p += history_idx - common;
+  memset(s->history_ + history_idx, 0, State::kHistorySize - history_idx);
+  s->history_idx_ = history_idx;
+  return true;
+}
+
+PackedBin::PackedBin(StateVec states)
+    : bin_(states.front()->Bin()), size_(states.size()) {
+  SortByTime(states);
+  State prev = BinTemplate(bin_);
+  for (auto &s : states) {
+    assert(s->Bin() == bin_);
+    Encode(prev, *s, &data_);
+    prev = *s;
+    s.reset();
+  }
+  data_.shrink_to_fit();
+}
+
+PackedBin::Reader::Reader(const PackedBin &packed)
+    : packed_(packed), remaining_(packed.size_),
+      prev_(BinTemplate(packed.bin_)) {}
+
+std::unique_ptr<State> PackedBin::Reader::Next() {
+  const char *p = packed_.data_.data() + pos_;
+  // Bins are either packed here or checked by ParseAll().
+  const bool ok = Decode(p, packed_.data_.data() + packed_.data_.size(),
+                         &prev_);
+  assert(ok);
+  (void)ok;
+  pos_ = p - packed_.data_.data();
+  --remaining_;
+  return absl::make_unique<State>(prev_);
+}
+
+void PackedBin::UnpackInto(StateVec *out) const {
+  out->reserve(out->size() + size_);
+  for (Reader reader(*this); !reader.Done();) {
+    out->push_back(reader.Next());
+  }
+}
+
+void PackedBin::SplitInto(size_t max_size,
+                          std::vector<PackedBin> *out) const {
+  StateVec piece;
+  for (Reader reader(*this); !reader.Done();) {
+    piece.push_back(reader.Next());
+    if (piece.size() == max_size) {
+      out->emplace_back(std::move(piece));
+      piece.clear();
+    }
+  }
+  if (!piece.empty()) {
+    out->emplace_back(std::move(piece));
+  }
+}
+
+void PackedBin::AppendTo(std::string *out) const {
+  PackedHeader header;
+  memset(&header, 0, sizeof(header));
+  header.bin[0] = std::get<0>(bin_);
+  header.bin[1] = std::get<1>(bin_);
+  header.bin[2] = std::get<2>(bin_);
+  header.bin[3] = std::get<3>(bin_);
+  header.size = size_;
+  header.bytes = data_.size();
+  out->append(reinterpret_cast<const char *>(&header), sizeof(header));
+  out->append(data_.data(), data_.size());
+}
+
+bool PackedBin::ParseAll(absl::string_view data, std::vector<PackedBin> *out) {
+  while (!data.empty()) {
+    PackedHeader header;
+    if (data.size() < sizeof(header)) {
+      return false;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    data.remove_prefix(sizeof(header));
+    if (data.size() < header.bytes) {
+      return false;
+    }
+    PackedBin packed;
+    packed.bin_ = std::make_tuple(header.bin[0], header.bin[1], header.bin[2],
+                                  header.bin[3]);
+    packed.size_ = header.size;
+    packed.data_.assign(data.data(), header.bytes);
+    data.remove_prefix(header.bytes);
+    // Decode every state once, so a truncated or corrupt bin is caught here
+    // rather than read past the end of later.
+    const char *p = packed.data_.data();
+    const char *end = p + packed.data_.size();
+    State s = BinTemplate(packed.bin_);
+    for (size_t i = 0; i < packed.size_; ++i) {
+      if (!Decode(p, end, &s)) {
+        return false;
+      }
+    }
+    if (p != end) {
+      return false;
+    }
+    out->push_back(std::move(packed));
+  }
+  return true;
+}
+
+void PackingWriter::Push(std::unique_ptr<State> state) {
+  StateVec &waiting = waiting_[state->Bin()];
+  waiting.push_back(std::move(state));
+  if (waiting.size() >= kPieceSize) {
+    out_->emplace_back(std::move(waiting));
+    waiting.clear();
+    num_waiting_ -= kPieceSize - 1;
+  } else if (++num_waiting_ >= kMaxWaiting) {
+    Flush();
+  }
+}
+
+void PackingWriter::Flush() {
+  for (auto &node : waiting_) {
+    if (!node.second.empty()) {
+      out_->emplace_back(std::move(node.second));
+    }
+  }
+  waiting_.clear();
+  num_waiting_ = 0;
+}
+
+size_t PackedSize(const std::vector<PackedBin> &bins) {
+  size_t ret = 0;
+  for (const PackedBin &packed : bins) {
+    ret += packed.size();
+  }
+  return ret;
+}
+
+} // namespace clips
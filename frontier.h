@@ -0,0 +1,127 @@
+#ifndef CLIPS_FRONTIER_H_
+#define CLIPS_FRONTIER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "clips.h"
+#include "memory.h"
+
+namespace clips {
+
+// A hash map keyed by bin, whose table is counted as MemoryKind::kBinMaps.
+template <typename V>
+using BinMap = absl::flat_hash_map<
+    State::BinType, V, absl::Hash<State::BinType>,
+    std::equal_to<State::BinType>,
+    CountingAllocator<std::pair<const State::BinType, V>,
+                      MemoryKind::kBinMaps>>;
+
+// States that share a Bin(), compressed for storage between strides.
+//
+// States are sorted by time and each is stored as the difference from the
+// one before it: time as a varint delta, the other resources as the nonzero
+// bytes of their XOR, trust and the project mask as varints, and the history
+// as the length of the prefix it shares plus the rest.  The bin's own fields
+// are stored once.  A typical state takes about 30 bytes, against 120 for
+// an unpacked one plus its heap allocation.
+class PackedBin {
+public:
+  PackedBin() = default;
+  PackedBin(PackedBin &&) = default;
+  PackedBin &operator=(PackedBin &&) = default;
+
+  // The encoded states, counted as MemoryKind::kPackedBins.
+  using Data = std::basic_string<
+      char, std::char_traits<char>,
+      CountingAllocator<char, MemoryKind::kPackedBins>>;
+
+  // Pack a nonempty set of states, all with the same Bin().
+  explicit PackedBin(StateVec states);
+
+  const State::BinType &bin() const { return bin_; }
+  size_t size() const { return size_; }
+  size_t bytes() const { return data_.size(); }
+
+  // Decodes the states of a PackedBin one at a time, in time order.  The
+  // PackedBin must outlive the reader.
+  class Reader {
+  public:
+    explicit Reader(const PackedBin &packed);
+
+    bool Done() const { return remaining_ == 0; }
+    std::unique_ptr<State> Next();
+
+  private:
+    const PackedBin &packed_;
+    size_t pos_ = 0;
+    size_t remaining_;
+    State prev_;
+  };
+
+  // Append every state to `out`.
+  void UnpackInto(StateVec *out) const;
+
+  // Repack into pieces of at most `max_size` states each, in time order,
+  // appended to `out`.
+  void SplitInto(size_t max_size, std::vector<PackedBin> *out) const;
+
+  // Serialize this bin onto the end of `out`.  The encoding is only
+  // readable by the same build of this program on the same architecture.
+  void AppendTo(std::string *out) const;
+
+  // Parse every bin written by AppendTo() in `data`.  Returns false if the
+  // data is truncated or malformed.
+  static bool ParseAll(absl::string_view data, std::vector<PackedBin> *out);
+
+private:
+  // What the first state is encoded against: defaults, with the bin's fields
+  // filled in.
+  static State BinTemplate(const State::BinType &bin);
+  static void Encode(const State &prev, const State &s, Data *out);
+  // Overwrite *s, which holds the previous state, with the next one read
+  // from `p`.  Returns false if it would read past `end`, or the data is
+  // malformed.
+  static bool Decode(const char *&p, const char *end, State *s);
+
+  State::BinType bin_;
+  size_t size_ = 0;
+  Data data_;
+};
+
+// Packs states as they arrive, a piece per bin.  A bin's states are packed
+// once kPieceSize of them are waiting, and everything waiting is packed once
+// kMaxWaiting states are.
+class PackingWriter {
+public:
+  static constexpr size_t kPieceSize = 4096;
+  static constexpr size_t kMaxWaiting = 1 << 16;
+
+  explicit PackingWriter(std::vector<PackedBin> *out) : out_(out) {}
+  PackingWriter(const PackingWriter &) = delete;
+  PackingWriter &operator=(const PackingWriter &) = delete;
+  ~PackingWriter() { Flush(); }
+
+  void Push(std::unique_ptr<State> state);
+
+  // Pack everything waiting.
+  void Flush();
+
+private:
+  std::vector<PackedBin> *out_;
+  BinMap<StateVec> waiting_;
+  size_t num_waiting_ = 0;
+};
+
+// Total number of states in a list of packed bins.
+size_t PackedSize(const std::vector<PackedBin> &bins);
+
+} // namespace clips
+
+#endif // CLIPS_FRONTIER_H_
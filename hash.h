@@ -0,0 +1,22 @@
+#ifndef CLIPS_HASH_H_
+#define CLIPS_HASH_H_
+
+#include <cstdint>
+
+namespace clips {
+
+// splitmix64's increment.  Added to a value before Mix64(), so that zero
+// doesn't hash to zero.
+constexpr uint64_t kGoldenGamma = 0x9e3779b97f4a7c15;
+
+// The splitmix64 finalizer.  Unlike absl::Hash, it gives the same answer in
+// every process, so it can key what is kept on disk or shared with workers.
+inline uint64_t Mix64(uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+  return x ^ (x >> 31);
+}
+
+} // namespace clips
+
+#endif // CLIPS_HASH_H_
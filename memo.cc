@@ -0,0 +1,127 @@
+#include "memo.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace clips {
+
+namespace {
+
+// Bumped whenever State::Fingerprint() changes, since old keys no longer
+// mean anything.
+constexpr char kMagic[8] = {'c', 'l', 'i', 'p', 'm', 'e', 'm', '2'};
+
+struct MemoHeader {
+  char magic[8];
+  uint64_t size;
+};
+
+} // namespace
+
+std::unique_ptr<MemoTable> MemoTable::Open(const std::string &path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(MemoHeader)) {
+    close(fd);
+    return nullptr;
+  }
+  const size_t bytes = st.st_size;
+  void *map = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return nullptr;
+  }
+  MemoHeader header;
+  memcpy(&header, map, sizeof(header));
+  if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      bytes != sizeof(header) + header.size * sizeof(Entry)) {
+    munmap(map, bytes);
+    return nullptr;
+  }
+  return std::unique_ptr<MemoTable>(new MemoTable(map, bytes));
+}
+
+MemoTable::MemoTable(void *map, size_t map_bytes)
+    : map_(map), map_bytes_(map_bytes),
+      entries_(reinterpret_cast<const Entry *>(static_cast<const char *>(map) +
+                                               sizeof(MemoHeader))),
+      size_((map_bytes - sizeof(MemoHeader)) / sizeof(Entry)) {}
+
+MemoTable::~MemoTable() { munmap(map_, map_bytes_); }
+
+double MemoTable::WinTime(const State &s) const {
+  const uint64_t key = s.Fingerprint();
+  const Entry *end = entries_ + size_;
+  const Entry *it = std::lower_bound(
+      entries_, end, key,
+      [](const Entry &e, uint64_t key) { return e.key < key; });
+  return (it != end && it->key == key) ? it->win_time : HUGE_VAL;
+}
+
+int MemoTable::BestBranch(const State::BranchList &branches) const {
+  int best = -1;
+  double best_time = HUGE_VAL;
+  for (size_t i = 0; i < branches.size(); ++i) {
+    const double t = WinTime(*branches[i]);
+    if (t < best_time) {
+      best = static_cast<int>(i);
+      best_time = t;
+    }
+  }
+  return best;
+}
+
+void MemoWriter::Record(uint64_t key, double win_time) {
+  auto it = entries_.emplace(key, win_time).first;
+  it->second = std::min(it->second, win_time);
+}
+
+bool MemoWriter::Write(const std::string &path) {
+  if (std::unique_ptr<MemoTable> old = MemoTable::Open(path)) {
+    for (size_t i = 0; i < old->size_; ++i) {
+      Record(old->entries_[i].key, old->entries_[i].win_time);
+    }
+  }
+  std::vector<MemoTable::Entry> sorted;
+  sorted.reserve(entries_.size());
+  for (const auto &node : entries_) {
+    sorted.push_back({node.first, node.second});
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [](const MemoTable::Entry &a, const MemoTable::Entry &b) {
+              return a.key < b.key;
+            });
+
+  // Write beside the old table and rename over it, so readers never see a
+  // partial one.
+  const std::string tmp = path + ".tmp";
+  FILE *f = fopen(tmp.c_str(), "wb");
+  if (f == nullptr) {
+    return false;
+  }
+  MemoHeader header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.size = sorted.size();
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+            fwrite(sorted.data(), sizeof(sorted[0]), sorted.size(), f) ==
+                sorted.size();
+  ok = (fclose(f) == 0) && ok;
+  if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+    unlink(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+} // namespace clips
@@ -0,0 +1,81 @@
+#ifndef CLIPS_MEMO_H_
+#define CLIPS_MEMO_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "clips.h"
+
+namespace clips {
+
+// A table from states to the earliest win known to be reachable from them,
+// kept on disk so that searches can fill it in and tools can consult it.
+// States are keyed by State::Fingerprint(), so a state is found however it
+// was reached, as long as it matches a recorded one field for field.
+//
+// The file is a header followed by entries sorted by key.  It is mapped
+// into memory rather than read, so opening even a large table is quick,
+// and a lookup is a binary search.  Like PackedBin, the format is only
+// readable on the architecture that wrote it.
+class MemoTable {
+public:
+  // Map the table at `path`.  Returns nullptr if it can't be read or isn't
+  // a memo table.
+  static std::unique_ptr<MemoTable> Open(const std::string &path);
+
+  MemoTable(const MemoTable &) = delete;
+  MemoTable &operator=(const MemoTable &) = delete;
+  ~MemoTable();
+
+  size_t size() const { return size_; }
+
+  // The earliest known time a win can be reached from `s`, or HUGE_VAL.
+  double WinTime(const State &s) const;
+
+  // The index of the branch with the earliest known win, or -1 if none of
+  // them is in the table.
+  int BestBranch(const State::BranchList &branches) const;
+
+private:
+  friend class MemoWriter;
+
+  struct Entry {
+    uint64_t key;
+    double win_time;
+  };
+
+  MemoTable(void *map, size_t map_bytes);
+
+  void *map_;
+  size_t map_bytes_;
+  const Entry *entries_;
+  size_t size_;
+};
+
+// Collects entries for a memo table.
+class MemoWriter {
+public:
+  // Record that a win at `win_time` can be reached from `s`.
+  void Record(const State &s, double win_time) {
+    Record(s.Fingerprint(), win_time);
+  }
+
+  size_t size() const { return entries_.size(); }
+
+  // Write the table to `path`, merged with the one already there.  Where
+  // both know of a win from the same state, the earlier one is kept.
+  // Returns false on error, leaving the old table in place.
+  bool Write(const std::string &path);
+
+private:
+  void Record(uint64_t key, double win_time);
+
+  absl::flat_hash_map<uint64_t, double> entries_;
+};
+
+} // namespace clips
+
+#endif // CLIPS_MEMO_H_
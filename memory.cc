@@ -0,0 +1,70 @@
+#include "memory.h"
+
+#include <mutex>
+
+namespace clips {
+
+namespace {
+
+std::mutex &UsageMutex() {
+  static std::mutex *mu = new std::mutex;
+  return *mu;
+}
+
+// Guarded by UsageMutex().
+MemoryUsage &SharedUsage() {
+  static MemoryUsage *usage = new MemoryUsage;
+  return *usage;
+}
+
+} // namespace
+
+namespace memory_internal {
+
+thread_local PendingCounts pending;
+
+PendingCounts::~PendingCounts() { Flush(this); }
+
+void Flush(PendingCounts *counts) {
+  std::lock_guard<std::mutex> lock(UsageMutex());
+  MemoryUsage &usage = SharedUsage();
+  for (int i = 0; i < kNumMemoryKinds; ++i) {
+    usage.bytes[i] += counts->bytes[i];
+    usage.total += counts->bytes[i];
+    counts->bytes[i] = 0;
+  }
+  if (usage.total > usage.peak) {
+    usage.peak = usage.total;
+    usage.peak_bytes = usage.bytes;
+  }
+}
+
+} // namespace memory_internal
+
+MemoryUsage GetMemoryUsage() {
+  std::lock_guard<std::mutex> lock(UsageMutex());
+  return SharedUsage();
+}
+
+void ResetMemoryPeak() {
+  std::lock_guard<std::mutex> lock(UsageMutex());
+  MemoryUsage &usage = SharedUsage();
+  usage.peak = usage.total;
+  usage.peak_bytes = usage.bytes;
+}
+
+const char *MemoryKindName(MemoryKind kind) {
+  switch (kind) {
+  case MemoryKind::kStates:
+    return "states";
+  case MemoryKind::kBranchLists:
+    return "branch lists";
+  case MemoryKind::kBinMaps:
+    return "bin maps";
+  case MemoryKind::kPackedBins:
+    return "packed bins";
+  }
+  return "?";
+}
+
+} // namespace clips
@@ -0,0 +1,100 @@
+#ifndef CLIPS_MEMORY_H_
+#define CLIPS_MEMORY_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace clips {
+
+// What the bytes counted below are holding.
+enum class MemoryKind {
+  kStates,      // heap-allocated states
+  kBranchLists, // BranchList buffers that outgrew their inline space
+  kBinMaps,     // hash tables keyed by bin
+  kPackedBins,  // PackedBin data
+};
+constexpr int kNumMemoryKinds = 4;
+
+// A snapshot of the counted bytes, by kind.
+struct MemoryUsage {
+  std::array<int64_t, kNumMemoryKinds> bytes = {};
+  int64_t total = 0;
+  // The most that was counted at once since the last ResetMemoryPeak(),
+  // and how it broke down.
+  int64_t peak = 0;
+  std::array<int64_t, kNumMemoryKinds> peak_bytes = {};
+};
+
+namespace memory_internal {
+
+// Each thread counts into its own PendingCounts, and adds them to the shared
+// totals once a kind has drifted by kFlushBytes, or when the thread exits.
+// So the totals, and the peak, can be off by that much per thread and kind.
+constexpr int64_t kFlushBytes = 1 << 20;
+
+struct PendingCounts {
+  ~PendingCounts();
+  std::array<int64_t, kNumMemoryKinds> bytes = {};
+};
+
+extern thread_local PendingCounts pending;
+
+void Flush(PendingCounts *counts);
+
+} // namespace memory_internal
+
+// Count `bytes` more (or, if negative, fewer) bytes of `kind` in use.
+inline void CountMemory(MemoryKind kind, int64_t bytes) {
+  memory_internal::PendingCounts &counts = memory_internal::pending;
+  int64_t &count = counts.bytes[static_cast<int>(kind)];
+  count += bytes;
+  if (count > memory_internal::kFlushBytes ||
+      count < -memory_internal::kFlushBytes) {
+    memory_internal::Flush(&counts);
+  }
+}
+
+MemoryUsage GetMemoryUsage();
+
+// Start a new high-water mark at the current total.
+void ResetMemoryPeak();
+
+// The name of a kind, for reports.
+const char *MemoryKindName(MemoryKind kind);
+
+// A std::allocator that counts what it holds as `kind`.
+template <typename T, MemoryKind kind> class CountingAllocator {
+public:
+  using value_type = T;
+  template <typename U> struct rebind {
+    using other = CountingAllocator<U, kind>;
+  };
+
+  CountingAllocator() = default;
+  template <typename U>
+  CountingAllocator(const CountingAllocator<U, kind> &) {}
+
+  T *allocate(size_t n) {
+    CountMemory(kind, n * sizeof(T));
+    return std::allocator<T>().allocate(n);
+  }
+  void deallocate(T *p, size_t n) {
+    CountMemory(kind, -static_cast<int64_t>(n * sizeof(T)));
+    std::allocator<T>().deallocate(p, n);
+  }
+
+  template <typename U>
+  bool operator==(const CountingAllocator<U, kind> &) const {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const CountingAllocator<U, kind> &) const {
+    return false;
+  }
+};
+
+} // namespace clips
+
+#endif // CLIPS_MEMORY_H_
@@ -0,0 +1,166 @@
+#include "net.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <thread>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "hash.h"
+
+namespace clips {
+
+namespace {
+
+struct FrameHeader {
+  uint32_t type;
+  uint32_t arg;
+  uint64_t size;
+};
+
+bool WriteFull(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = write(fd, data, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool ReadFull(int fd, char *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = read(fd, data, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+void SetNoDelay(int fd) {
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+} // namespace
+
+Connection::~Connection() { close(fd_); }
+
+bool Connection::Send(uint32_t type, uint32_t arg, absl::string_view payload) {
+  FrameHeader header = {type, arg, payload.size()};
+  return WriteFull(fd_, reinterpret_cast<const char *>(&header),
+                   sizeof(header)) &&
+         WriteFull(fd_, payload.data(), payload.size());
+}
+
+bool Connection::Receive(Message *msg) {
+  FrameHeader header;
+  if (!ReadFull(fd_, reinterpret_cast<char *>(&header), sizeof(header))) {
+    return false;
+  }
+  msg->type = header.type;
+  msg->arg = header.arg;
+  msg->payload.resize(header.size);
+  return ReadFull(fd_, &msg->payload[0], header.size);
+}
+
+std::string Connection::PeerHost() const {
+  sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  if (getpeername(fd_, reinterpret_cast<sockaddr *>(&addr), &len) != 0) {
+    return "";
+  }
+  char buf[INET_ADDRSTRLEN];
+  return inet_ntop(AF_INET, &addr.sin_addr, buf, sizeof(buf)) ? buf : "";
+}
+
+int ListenTcp(int port, int *bound_port) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  socklen_t len = sizeof(addr);
+  if (bind(fd, reinterpret_cast<sockaddr *>(&addr), len) != 0 ||
+      listen(fd, 64) != 0 ||
+      getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &len) != 0) {
+    close(fd);
+    return -1;
+  }
+  *bound_port = ntohs(addr.sin_port);
+  return fd;
+}
+
+std::unique_ptr<Connection> AcceptTcp(int listen_fd) {
+  int fd;
+  do {
+    fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+  } while (fd < 0 && errno == EINTR);
+  if (fd < 0) {
+    return nullptr;
+  }
+  SetNoDelay(fd);
+  return absl::make_unique<Connection>(fd);
+}
+
+std::unique_ptr<Connection> ConnectTcp(const std::string &host, int port) {
+  addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *res = nullptr;
+  if (getaddrinfo(host.c_str(), absl::StrCat(port).c_str(), &hints, &res) !=
+      0) {
+    return nullptr;
+  }
+  // The other side may still be starting up; give it a few seconds.
+  int fd = -1;
+  for (int attempt = 0; attempt < 50 && fd < 0; ++attempt) {
+    if (attempt > 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(res);
+  if (fd < 0) {
+    return nullptr;
+  }
+  SetNoDelay(fd);
+  return absl::make_unique<Connection>(fd);
+}
+
+uint64_t StableBinHash(const State::BinType &bin) {
+  const uint64_t packed = (uint64_t(std::get<0>(bin)) << 48) ^
+                          (uint64_t(std::get<1>(bin)) << 32) ^
+                          (uint64_t(std::get<2>(bin)) << 8) ^
+                          uint64_t(std::get<3>(bin));
+  return Mix64(packed + kGoldenGamma);
+}
+
+} // namespace clips
@@ -0,0 +1,56 @@
+#ifndef CLIPS_NET_H_
+#define CLIPS_NET_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "absl/strings/string_view.h"
+#include "clips.h"
+
+namespace clips {
+
+// A framed message: a type tag, a small integer argument, and a payload.
+struct Message {
+  uint32_t type = 0;
+  uint32_t arg = 0;
+  std::string payload;
+};
+
+// A blocking TCP connection carrying Messages.  One thread may send while
+// another receives, but two threads must not send (or receive) at once.
+class Connection {
+public:
+  explicit Connection(int fd) : fd_(fd) {}
+  Connection(const Connection &) = delete;
+  Connection &operator=(const Connection &) = delete;
+  ~Connection();
+
+  // Both return false if the connection is broken.
+  bool Send(uint32_t type, uint32_t arg, absl::string_view payload = "");
+  bool Receive(Message *msg);
+
+  // Numeric address of the other end.
+  std::string PeerHost() const;
+
+private:
+  int fd_;
+};
+
+// Listen for TCP connections on `port` (0 for any free port).  Returns the
+// listening socket and sets *bound_port, or returns -1 on error.
+int ListenTcp(int port, int *bound_port);
+
+// Accept one connection from a listening socket.  Returns nullptr on error.
+std::unique_ptr<Connection> AcceptTcp(int listen_fd);
+
+// Connect to host:port.  Returns nullptr on error.
+std::unique_ptr<Connection> ConnectTcp(const std::string &host, int port);
+
+// A hash of a bin that is the same in every process.  (absl::Hash is
+// salted per process, so it can't be used to partition bins across them.)
+uint64_t StableBinHash(const State::BinType &bin);
+
+} // namespace clips
+
+#endif // CLIPS_NET_H_
@@ -0,0 +1,402 @@
+#include "pareto.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <utility>
+
+namespace clips {
+
+namespace {
+
+// Run fn(0) through fn(n - 1) at once, each on its own thread.
+void ParallelFor(int n, const std::function<void(int)> &fn) {
+  std::vector<std::thread> threads;
+  for (int i = 1; i < n; ++i) {
+    threads.emplace_back(fn, i);
+  }
+  fn(0);
+  for (std::thread &t : threads) {
+    t.join();
+  }
+}
+
+// Run fn(0, threads) through fn(n - 1, threads) on `num_threads` threads,
+// where `threads` is each call's share of them.
+void ShareThreads(size_t n, int num_threads,
+                  const std::function<void(size_t, int)> &fn) {
+  const int workers = std::min<size_t>(n, num_threads);
+  const int threads_each = std::max(num_threads / workers, 1);
+  ParallelFor(workers, [&](int w) {
+    for (size_t i = w; i < n; i += workers) {
+      fn(i, threads_each);
+    }
+  });
+}
+
+// Map a time to an integer that sorts the same way.
+uint64_t TimeKey(double time) {
+  uint64_t bits;
+  memcpy(&bits, &time, sizeof(bits));
+  // Negative doubles sort backwards as integers, so flip them entirely;
+  // setting the sign bit of the rest puts them above the negatives.
+  return (bits >> 63) ? ~bits : bits | (uint64_t(1) << 63);
+}
+
+// A sort key, and the position in the input of the state it belongs to.
+using KeyIndex = std::pair<uint64_t, uint32_t>;
+
+constexpr int kRadixBits = 8;
+constexpr size_t kBuckets = size_t(1) << kRadixBits;
+// Below this size, comparison sorting the keys is faster.
+constexpr size_t kMinRadixSize = 256;
+// Below this size, sorting isn't worth starting threads for.
+constexpr size_t kMinParallelSortSize = size_t(1) << 16;
+
+// Stable LSD radix sort on the keys, split into one block per thread.
+void RadixSort(std::vector<KeyIndex> &items, int num_blocks) {
+  const size_t n = items.size();
+  auto block_begin = [&](int b) { return n * b / num_blocks; };
+  std::vector<KeyIndex> scratch(n);
+  std::vector<std::array<size_t, kBuckets>> offsets(num_blocks);
+  for (int shift = 0; shift < 64; shift += kRadixBits) {
+    auto digit = [shift](const KeyIndex &item) {
+      return (item.first >> shift) & (kBuckets - 1);
+    };
+    ParallelFor(num_blocks, [&](int b) {
+      offsets[b].fill(0);
+      for (size_t i = block_begin(b); i < block_begin(b + 1); ++i) {
+        ++offsets[b][digit(items[i])];
+      }
+    });
+    // Times in a bin are close together, so most high digits are shared by
+    // every key; those passes would move nothing.
+    size_t first_bucket_size = 0;
+    for (int b = 0; b < num_blocks; ++b) {
+      first_bucket_size += offsets[b][digit(items[0])];
+    }
+    if (first_bucket_size == n) {
+      continue;
+    }
+    // Each block writes its share of a bucket after the earlier blocks'.
+    size_t next = 0;
+    for (size_t bucket = 0; bucket < kBuckets; ++bucket) {
+      for (int b = 0; b < num_blocks; ++b) {
+        const size_t count = offsets[b][bucket];
+        offsets[b][bucket] = next;
+        next += count;
+      }
+    }
+    ParallelFor(num_blocks, [&](int b) {
+      for (size_t i = block_begin(b); i < block_begin(b + 1); ++i) {
+        scratch[offsets[b][digit(items[i])]++] = items[i];
+      }
+    });
+    items.swap(scratch);
+  }
+}
+
+// Below this many states, a merge isn't worth starting threads for.
+constexpr size_t kMinParallelMergeSize = 4096;
+// States are handed to merge threads in chunks this big, since the later
+// ones in a front take longer to check.
+constexpr size_t kMergeChunkSize = 256;
+
+// Cull states that share a SubBin().  Also right for states that only share
+// a Bin(), just slower.
+void CullEntriesInSubBin(StateVec &vec) {
+  SortByTime(vec);
+  // Sorted by time means that, generally, only later entries can be strictly
+  // worse than earlier ones.  The exception is close ties on time.
+  int i = 0;
+  while (i < static_cast<int>(vec.size())) {
+    // First look backwards for states with the same time as us but strictly
+    // worse values.
+    int j = i - 1;
+    while (j >= 0) {
+      if (vec[j]->Time() + State::eps < vec[i]->Time()) {
+        // Likely early exit.
+        break;
+      }
+      if (vec[j]->IsStrictlyWorseThan(*vec[i])) {
+        vec.erase(vec.begin() + j);
+        i -= 1; // index of our current item shifts left
+      }
+      --j;
+    }
+    // Now look forward for states that took longer to get to strictly worse
+    for (j = i + 1; j < static_cast<int>(vec.size());) {
+      if (vec[j]->IsStrictlyWorseThan(*vec[i])) {
+        vec.erase(vec.begin() + j);
+        continue;
+      }
+      ++j;
+    }
+    ++i;
+  }
+}
+
+// Below this size, a bin isn't worth culling until the set is taken.
+constexpr size_t kMinCullSize = 64;
+
+// Merge two fronts sorted by time into one, on `num_threads` threads.
+StateVec MergeTwoFronts(StateVec a, StateVec b, int num_threads) {
+  const size_t n = a.size() + b.size();
+  std::vector<char> keep(n);
+  const std::vector<const StateVec *> just_a = {&a};
+  const std::vector<const StateVec *> just_b = {&b};
+  std::atomic<size_t> next_chunk{0};
+  ParallelFor(n >= kMinParallelMergeSize ? num_threads : 1, [&](int) {
+    for (size_t begin; (begin = next_chunk.fetch_add(kMergeChunkSize)) < n;) {
+      const size_t end = std::min(n, begin + kMergeChunkSize);
+      for (size_t i = begin; i < end; ++i) {
+        keep[i] = (i < a.size()) ? !BeatenBy(*a[i], just_b, false)
+                                 : !BeatenBy(*b[i - a.size()], just_a, true);
+      }
+    }
+  });
+  StateVec ret;
+  ret.reserve(n);
+  size_t i = 0;
+  size_t j = 0;
+  while (i < a.size() || j < b.size()) {
+    if (j == b.size() || (i < a.size() && a[i]->Time() <= b[j]->Time())) {
+      if (keep[i]) {
+        ret.push_back(std::move(a[i]));
+      }
+      ++i;
+    } else {
+      if (keep[a.size() + j]) {
+        ret.push_back(std::move(b[j]));
+      }
+      ++j;
+    }
+  }
+  return ret;
+}
+
+} // namespace
+
+bool BeatenBy(const State &s, const std::vector<const StateVec *> &fronts,
+              bool ties_lose) {
+  // Only states no more than eps later than `s` can beat it.
+  const double cutoff = s.Time() + State::eps;
+  for (const StateVec *front : fronts) {
+    for (const auto &member : *front) {
+      if (member->Time() > cutoff) {
+        break;
+      }
+      if (s.IsStrictlyWorseThan(*member) &&
+          (ties_lose || !member->IsStrictlyWorseThan(s))) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void CullEntriesInBin(StateVec &vec) {
+  SortByTime(vec);
+  std::stable_sort(vec.begin(), vec.end(), [](const auto &a, const auto &b) {
+    return a->SubBin() < b->SubBin();
+  });
+  std::vector<StateVec> sub_bins;
+  for (auto &entry : vec) {
+    if (sub_bins.empty() ||
+        entry->SubBin() != sub_bins.back().back()->SubBin()) {
+      sub_bins.emplace_back();
+    }
+    sub_bins.back().push_back(std::move(entry));
+  }
+  vec.clear();
+  for (StateVec &sub_bin : sub_bins) {
+    CullEntriesInSubBin(sub_bin);
+  }
+  std::vector<std::vector<char>> keep(sub_bins.size());
+  for (size_t a = 0; a < sub_bins.size(); ++a) {
+    const State::SubBinType mask = sub_bins[a][0]->SubBin();
+    std::vector<const StateVec *> rivals;
+    for (size_t b = 0; b < sub_bins.size(); ++b) {
+      const State &first = *sub_bins[b][0];
+      if (b != a && ((first.SubBin() & mask) == mask || first.Win())) {
+        rivals.push_back(&sub_bins[b]);
+      }
+    }
+    for (const auto &s : sub_bins[a]) {
+      keep[a].push_back(!BeatenBy(*s, rivals, /*ties_lose=*/true));
+    }
+  }
+  for (size_t a = 0; a < sub_bins.size(); ++a) {
+    for (size_t i = 0; i < sub_bins[a].size(); ++i) {
+      if (keep[a][i]) {
+        vec.push_back(std::move(sub_bins[a][i]));
+      }
+    }
+  }
+  SortByTime(vec);
+}
+
+
+void ParetoSet::Insert(std::unique_ptr<State> state) {
+  if (state->Win()) {
+    earliest_win_ = std::min(earliest_win_, state->Time());
+  }
+  Bin &bin = bins_[state->Bin()];
+  bin.states.push_back(std::move(state));
+  if (bin.states.size() >= std::max(2 * bin.culled_size, kMinCullSize)) {
+    Cull(bin, earliest_win_);
+  }
+}
+
+void ParetoSet::Merge(ParetoSet other) {
+  for (auto &node : other.bins_) {
+    for (auto &state : node.second.states) {
+      Insert(std::move(state));
+    }
+  }
+}
+
+size_t ParetoSet::size() const {
+  size_t ret = 0;
+  for (const auto &node : bins_) {
+    ret += node.second.states.size();
+  }
+  return ret;
+}
+
+void ParetoSet::Cull(Bin &bin, double earliest_win) {
+  if (bin.states.size() != bin.culled_size) {
+    CullEntriesInBin(bin.states);
+  }
+  // Sorted by time, so the states a win beats are all at the end.  A bin
+  // culled before the earliest win turned up may still hold some.
+  while (!bin.states.empty() &&
+         bin.states.back()->Time() > earliest_win + State::eps) {
+    bin.states.pop_back();
+  }
+  bin.culled_size = bin.states.size();
+}
+
+StateVec ParetoSet::TakeSorted(int num_threads) {
+  StateVec ret;
+  for (auto &node : bins_) {
+    Cull(node.second, earliest_win_);
+    for (auto &state : node.second.states) {
+      ret.push_back(std::move(state));
+    }
+  }
+  bins_.clear();
+  SortByTime(ret, num_threads);
+  return ret;
+}
+
+ParetoSet ParetoSet::MergeAll(std::vector<ParetoSet> sets, int num_threads) {
+  ParetoSet ret;
+  for (ParetoSet &set : sets) {
+    ret.earliest_win_ = std::min(ret.earliest_win_, set.earliest_win_);
+    for (auto &node : set.bins_) {
+      StateVec &states = ret.bins_[node.first].states;
+      for (auto &state : node.second.states) {
+        states.push_back(std::move(state));
+      }
+    }
+  }
+  std::vector<Bin *> bins;
+  for (auto &node : ret.bins_) {
+    bins.push_back(&node.second);
+  }
+  if (bins.empty()) {
+    return ret;
+  }
+  ShareThreads(bins.size(), std::max(num_threads, 1), [&](size_t i, int) {
+    Cull(*bins[i], ret.earliest_win_);
+  });
+  return ret;
+}
+
+bool EpsilonArchive::Insert(std::unique_ptr<State> state) {
+  for (const auto &member : states_) {
+    if (Yields(*state, *member)) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < states_.size();) {
+    if (Yields(*states_[i], *state)) {
+      states_[i] = std::move(states_.back());
+      states_.pop_back();
+      continue;
+    }
+    ++i;
+  }
+  states_.push_back(std::move(state));
+  return true;
+}
+
+StateVec EpsilonArchive::TakeSorted() {
+  StateVec ret = std::move(states_);
+  states_.clear();
+  SortByTime(ret);
+  return ret;
+}
+
+StateVec MergeParetoFronts(std::vector<StateVec> fronts, int num_threads) {
+  num_threads = std::max(num_threads, 1);
+  if (fronts.empty()) {
+    return StateVec();
+  }
+  ShareThreads(fronts.size(), num_threads, [&](size_t i, int threads) {
+    SortByTime(fronts[i], threads);
+  });
+  while (fronts.size() > 1) {
+    std::vector<StateVec> merged((fronts.size() + 1) / 2);
+    ShareThreads(merged.size(), num_threads, [&](size_t i, int threads) {
+      merged[i] = (2 * i + 1 < fronts.size())
+                      ? MergeTwoFronts(std::move(fronts[2 * i]),
+                                       std::move(fronts[2 * i + 1]), threads)
+                      : std::move(fronts[2 * i]);
+    });
+    fronts.swap(merged);
+  }
+  return std::move(fronts[0]);
+}
+
+void SortByTime(StateVec &vec, int num_threads) {
+  const size_t n = vec.size();
+  const int num_blocks =
+      (n >= kMinParallelSortSize) ? std::max(num_threads, 1) : 1;
+  auto block_begin = [&](int b) { return n * b / num_blocks; };
+
+  // Touch each state once for its key, and sort the keys.
+  std::vector<KeyIndex> keys(n);
+  ParallelFor(num_blocks, [&](int b) {
+    for (size_t i = block_begin(b); i < block_begin(b + 1); ++i) {
+      keys[i] = {TimeKey(vec[i]->Time()), i};
+    }
+  });
+  bool sorted = true;
+  for (size_t i = 1; i < n && sorted; ++i) {
+    sorted = keys[i - 1].first <= keys[i].first;
+  }
+  if (sorted) {
+    return;
+  }
+  if (n < kMinRadixSize) {
+    std::sort(keys.begin(), keys.end());
+  } else {
+    RadixSort(keys, num_blocks);
+  }
+
+  // Then move each state once, to its place.
+  StateVec ret(n);
+  ParallelFor(num_blocks, [&](int b) {
+    for (size_t i = block_begin(b); i < block_begin(b + 1); ++i) {
+      ret[i] = std::move(vec[keys[i].second]);
+    }
+  });
+  vec.swap(ret);
+}
+
+} // namespace clips
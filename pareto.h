@@ -0,0 +1,126 @@
+#ifndef CLIPS_PARETO_H_
+#define CLIPS_PARETO_H_
+
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "clips.h"
+
+namespace clips {
+
+// A set of states, none of which is strictly worse than another.
+//
+// States are kept by Bin(), and a bin is only culled with CullEntriesInBin()
+// once it has doubled in size since its last cull, so filling a set costs
+// about as much as culling its states once.  A win is the one way to be
+// strictly worse than a state in another bin, so the earliest win is also
+// tracked, and anything more than eps later is dropped.
+class ParetoSet {
+public:
+  ParetoSet() = default;
+  ParetoSet(ParetoSet &&) = default;
+  ParetoSet &operator=(ParetoSet &&) = default;
+
+  // Add a state to the set.  It is dropped by a later cull if it is strictly
+  // worse than another state added.
+  void Insert(std::unique_ptr<State> state);
+
+  // Insert every member of `other` into this set.
+  void Merge(ParetoSet other);
+
+  // The number of states held, some of which may not have been culled yet.
+  size_t size() const;
+  bool empty() const { return size() == 0; }
+
+  // Release the members of this set, sorted by time.
+  StateVec TakeSorted(int num_threads = 1);
+
+  // Merge many sets into one, culling its bins on `num_threads` threads.
+  static ParetoSet MergeAll(std::vector<ParetoSet> sets, int num_threads);
+
+private:
+  struct Bin {
+    StateVec states;
+    // states.size() after the last cull.
+    size_t culled_size = 0;
+  };
+
+  // Cull `bin` if it has grown since it was last culled, and drop the
+  // states a win at `earliest_win` beats.
+  static void Cull(Bin &bin, double earliest_win);
+
+  absl::flat_hash_map<State::BinType, Bin> bins_;
+  double earliest_win_ = HUGE_VAL;
+};
+
+// An approximate ParetoSet, for states that share a Bin().
+//
+// States are compared on a grid of the given tolerances (see
+// State::IsApproximatelyWorseThan), so states within one grid cell of each
+// other collapse to a single survivor.  Every rejected state trails some
+// member by less than one tolerance in each resource, and since grid
+// dominance is transitive, that stays true as members are replaced.
+class EpsilonArchive {
+public:
+  explicit EpsilonArchive(const Tolerance &tol) : tol_(tol) {}
+
+  // Add a state to the archive, unless a member approximately beats it.  Any
+  // members the new state approximately beats are dropped.  Returns true if
+  // the state was kept.
+  bool Insert(std::unique_ptr<State> state);
+
+  size_t size() const { return states_.size(); }
+
+  // Release the members of this archive, sorted by time.
+  StateVec TakeSorted();
+
+private:
+  // True if `a` should give way to `b`.  Exact dominance wins over the grid,
+  // so a state in the same cell as a strictly better one never evicts it.
+  bool Yields(const State &a, const State &b) const {
+    return a.IsStrictlyWorseThan(b) || (a.IsApproximatelyWorseThan(b, tol_) &&
+                                        !b.IsStrictlyWorseThan(a));
+  }
+
+  Tolerance tol_;
+  StateVec states_;
+};
+
+// True if `s` is strictly worse than a member of one of `fronts`, each of
+// which is sorted by time.  If `ties_lose` is false, members that are also
+// strictly worse than `s` don't count.
+bool BeatenBy(const State &s, const std::vector<const StateVec *> &fronts,
+              bool ties_lose);
+
+// Cull states that share a Bin(), leaving those that aren't strictly worse
+// than another, sorted by time.
+//
+// The bin is split by SubBin(), and each sub-bin is culled on its own.  Then
+// each state is checked only against the sub-bins that could beat it: those
+// whose project masks are strict supersets of its own, and wins.  Since
+// states in different sub-bins can't each be worse than the other, which
+// survives doesn't depend on the order of the checks.
+void CullEntriesInBin(StateVec &vec);
+
+// Merge vectors of states, none of which has a member strictly worse than
+// another of its own, into one such vector, sorted by time.
+//
+// Pairs of fronts are merged in a tree.  The merges of each round run at
+// once, and when there are fewer merges than threads, each merge is split
+// between the spare ones.  A merge only compares each state with the other
+// front's states that are no later than it.  Where two states are each
+// strictly worse than the other, the one from the earlier front is kept.
+StateVec MergeParetoFronts(std::vector<StateVec> fronts, int num_threads);
+
+// Sort a vector of states by time.  Ties keep their order.
+//
+// This is a radix sort on keys pulled from the states, so each state is
+// read once and moved once.  Large vectors are split between `num_threads`
+// threads.
+void SortByTime(StateVec &vec, int num_threads = 1);
+
+} // namespace clips
+
+#endif // CLIPS_PARETO_H_
@@ -0,0 +1,147 @@
+#include "replay.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+
+namespace clips {
+
+namespace {
+
+// Which branch a line of play took, after the steps before it.  Lines
+// share their common steps.
+struct Step {
+  std::shared_ptr<const Step> prev;
+  int branch;
+};
+
+// A line of play, and when it made each of its purchases.
+struct Line {
+  std::unique_ptr<State> state;
+  std::vector<double> purchase_times;
+  // Only kept for ReplayOptions::record_line.
+  std::shared_ptr<const Step> steps;
+};
+
+// Play the branches `steps` took again, and keep every state on the way.
+StateVec Retrace(const Step *steps, double time_limit) {
+  std::vector<int> branches;
+  for (; steps != nullptr; steps = steps->prev.get()) {
+    branches.push_back(steps->branch);
+  }
+  StateVec line;
+  line.push_back(absl::make_unique<State>());
+  for (auto it = branches.rbegin(); it != branches.rend(); ++it) {
+    line.push_back(std::move(
+        line.back()->Branches(State::kTimeLimit, time_limit)[*it]));
+  }
+  return line;
+}
+
+// Orders a heap so the earliest line is on top.
+bool Later(const Line &a, const Line &b) {
+  return a.state->Time() > b.state->Time();
+}
+
+} // namespace
+
+bool ParsePlan(absl::string_view text, Plan *plan) {
+  plan->clear();
+  for (absl::string_view entry :
+       absl::StrSplit(text, ' ', absl::SkipWhitespace())) {
+    int value;
+    if (!absl::SimpleAtoi(entry, &value) || value < 0 || value > 148) {
+      return false;
+    }
+    plan->push_back(value);
+  }
+  // Every plan makes a purchase; a blank line would otherwise be done at
+  // time 0.
+  return !plan->empty();
+}
+
+ReplayResult ReplayPlan(const Plan &plan, const ReplayOptions &options) {
+  ReplayResult result;
+  if (plan.size() >= State::kHistorySize) {
+    return result;
+  }
+  const int plan_size = plan.size();
+  auto done = [&](const State &s) {
+    return s.HistorySize() == plan_size && (!options.until_win || s.Win());
+  };
+
+  std::vector<Line> heap;
+  heap.push_back({absl::make_unique<State>(), {}, nullptr});
+  while (!heap.empty()) {
+    std::pop_heap(heap.begin(), heap.end(), Later);
+    Line line = std::move(heap.back());
+    heap.pop_back();
+    if (done(*line.state)) {
+      result.valid = true;
+      result.finish_time = line.state->Time();
+      result.purchase_times = std::move(line.purchase_times);
+      result.final_state = std::move(line.state);
+      if (options.record_line) {
+        result.line = Retrace(line.steps.get(), options.time_limit);
+      }
+      return result;
+    }
+    const int made = line.state->HistorySize();
+    State::BranchList branches =
+        line.state->Branches(State::kTimeLimit, options.time_limit);
+    for (size_t i = 0; i < branches.size(); ++i) {
+      std::unique_ptr<State> &child = branches[i];
+      // A branch may make more than one purchase (a spree), or none.
+      const int n = child->HistorySize();
+      if (n > plan_size || !std::equal(plan.begin() + made, plan.begin() + n,
+                                       child->HistoryBegin() + made)) {
+        continue;
+      }
+      if (child->AtGoal(State::kTimeLimit, options.time_limit) &&
+          !done(*child)) {
+        continue;
+      }
+      std::vector<double> purchase_times = line.purchase_times;
+      purchase_times.resize(n, child->Time());
+      std::shared_ptr<const Step> steps;
+      if (options.record_line) {
+        steps = std::make_shared<const Step>(
+            Step{line.steps, static_cast<int>(i)});
+      }
+      heap.push_back(
+          {std::move(child), std::move(purchase_times), std::move(steps)});
+      std::push_heap(heap.begin(), heap.end(), Later);
+    }
+  }
+  return result;
+}
+
+std::vector<ReplayResult> ReplayPlans(const std::vector<Plan> &plans,
+                                      const ReplayOptions &options,
+                                      int num_threads) {
+  if (num_threads <= 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  std::vector<ReplayResult> results(plans.size());
+  std::atomic<size_t> next_plan{0};
+  auto work = [&]() {
+    for (size_t i; (i = next_plan.fetch_add(1)) < plans.size();) {
+      results[i] = ReplayPlan(plans[i], options);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 1; i < num_threads; ++i) {
+    threads.emplace_back(work);
+  }
+  work();
+  for (std::thread &t : threads) {
+    t.join();
+  }
+  return results;
+}
+
+} // namespace clips
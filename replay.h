@@ -0,0 +1,70 @@
+#ifndef CLIPS_REPLAY_H_
+#define CLIPS_REPLAY_H_
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "clips.h"
+
+namespace clips {
+
+// A purchase plan, in the form State::History() logs it:
+//   0-127    a marketing level, bought while owning this many autoclippers
+//   128      a processor
+//   129      memory
+//   130-148  a project
+using Plan = std::vector<uint8_t>;
+
+// Parse a plan as printed by State::History().  Returns false if `text`
+// isn't a nonempty list of log entries.
+bool ParsePlan(absl::string_view text, Plan *plan);
+
+struct ReplayOptions {
+  // If true, a plan is only done once the game is won, with no purchases
+  // beyond the plan.  Otherwise it is done with its last purchase.
+  bool until_win = false;
+  // Lines of play that run past this time are abandoned.
+  double time_limit = 15000.;
+  // If true, keep every state on the line of play that finishes the plan.
+  bool record_line = false;
+};
+
+struct ReplayResult {
+  // True if some line of play makes exactly the plan's purchases.
+  bool valid = false;
+  // The earliest time the plan can be done, and when each purchase is made
+  // on the way.
+  double finish_time = HUGE_VAL;
+  std::vector<double> purchase_times;
+  // The state the plan ends in.
+  std::unique_ptr<State> final_state;
+  // With ReplayOptions::record_line, the states from the start of the game
+  // up to final_state, each a branch of the one before it.
+  StateVec line;
+};
+
+// Play a plan from the start of the game, and find when it can be done.
+//
+// A plan leaves some decisions open (when to buy autoclippers, which
+// thresholds to save past), so this searches every line of play whose
+// purchases agree with the plan so far, earliest first.  Nothing is culled:
+// a state with more resources can reach a threshold sooner and be forced
+// into purchases in a different order, so dominance doesn't carry over to
+// plans.  Plans that fill the history a State records can't be checked,
+// since purchases past the end of it go unrecorded, and are never valid.
+ReplayResult ReplayPlan(const Plan &plan,
+                        const ReplayOptions &options = ReplayOptions());
+
+// Replay many plans on `num_threads` threads (0 means one per hardware
+// thread).  Results are in the same order as the plans.
+std::vector<ReplayResult>
+ReplayPlans(const std::vector<Plan> &plans,
+            const ReplayOptions &options = ReplayOptions(),
+            int num_threads = 0);
+
+} // namespace clips
+
+#endif // CLIPS_REPLAY_H_
@@ -1,158 +1,1164 @@
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
 #include <memory>
+#include <mutex>
+#include <string>
 #include <thread>
 #include <vector>
 
-#include "absl/container/flat_hash_map.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
 #include "absl/memory/memory.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/str_split.h"
 #include "absl/time/clock.h"
 #include "clips.h"
+#include "frontier.h"
+#include "memo.h"
+#include "memory.h"
+#include "net.h"
+#include "pareto.h"
+#include "replay.h"
+
+ABSL_FLAG(double, approx_time, 0.,
+          "Grid size in seconds for approximate culls.  When any approx_* "
+          "flag is set, the stride culls keep one state per grid cell "
+          "instead of the exact Pareto set.");
+ABSL_FLAG(double, approx_dollars, 0., "Grid size in dollars for culls.");
+ABSL_FLAG(double, approx_ops, 0., "Grid size in ops for culls.");
+ABSL_FLAG(double, approx_creat, 0., "Grid size in creat for culls.");
+ABSL_FLAG(double, approx_clips, 0., "Grid size in clips for culls.");
+ABSL_FLAG(bool, adaptive_cull, true,
+          "Decide after each stride (and per bin) whether culling is worth "
+          "it.  If false, cull every 100 seconds.");
+ABSL_FLAG(int64_t, memory_budget_mb, 0,
+          "Resident memory the adaptive cull schedule tries to stay under.  "
+          "0 means 80% of physical memory (split between spawned workers).");
+ABSL_FLAG(int64_t, memory_limit_mb, 0,
+          "Hard limit on the memory counted by the search (states, branch "
+          "lists, bin maps and packed bins).  Past it, a stride stops to cull "
+          "what it has reached, and spills that to --spill_dir if it's still "
+          "over.  0 means the same as --memory_budget_mb.");
+ABSL_FLAG(std::string, spill_dir, "/tmp",
+          "Where to spill the pool when it passes --memory_limit_mb.");
+ABSL_FLAG(int, num_workers, 0,
+          "If nonzero, run as the coordinator of a distributed search with "
+          "this many worker processes.  Each worker owns the bins whose "
+          "hash falls in its partition.");
+ABSL_FLAG(int, port, 0,
+          "Port the coordinator listens on for workers (0 picks one).");
+ABSL_FLAG(bool, spawn_workers, true,
+          "Have the coordinator start its workers on this host.");
+ABSL_FLAG(std::string, coordinator, "",
+          "If set (as host:port), run as a worker of that coordinator.");
+ABSL_FLAG(std::string, memo_file, "",
+          "If set, replay the wins a local search finds, and add every state "
+          "on their lines of play to the memo table in this file.");
+ABSL_FLAG(double, cross_check_until, 0.,
+          "If nonzero, instead of searching, explore every state up to this "
+          "time with both the double and fixed-point representations, and "
+          "compare them.");
 
-using StateVec = std::vector<std::unique_ptr<clips::State>>;
+using clips::StateVec;
 
 constexpr double time_upper_bound = 1026.;
 
-void ForEachVec(std::vector<StateVec *> vecs,
-                std::function<void(StateVec &)> fn) {
+// The search advances the pool in strides of kStride seconds up to
+// kLastStride, then runs everything left to kFinalGoal.
+constexpr int kStride = 25;
+constexpr int kLastStride = 1100;
+constexpr double kFinalGoal = 15000.;
+
+// The pool between strides, packed by bin.  A bin may be split over several
+// pieces.
+using Frontier = std::vector<clips::PackedBin>;
+
+const int kNumWorkers = std::max(1u, std::thread::hardware_concurrency());
+
+void Die(const std::string &message) {
+  std::cerr << message << "\n";
+  exit(1);
+}
+
+// Run fn(worker_index) on `num_workers` threads, and wait for them all.
+void RunWorkers(int num_workers, const std::function<void(int)> &fn) {
+  if (num_workers == 1) {
+    fn(0);
+    return;
+  }
   std::vector<std::thread> threads;
-  for (StateVec *v : vecs) {
-    threads.emplace_back([=]() { fn(*v); });
+  for (int i = 0; i < num_workers; ++i) {
+    threads.emplace_back([&fn, i]() { fn(i); });
   }
   for (std::thread &t : threads) {
     t.join();
   }
 }
 
-void CullEntriesInBin(StateVec &vec) {
-  std::sort(vec.begin(), vec.end(),
-            [](const std::unique_ptr<clips::State> &s1,
-               const std::unique_ptr<clips::State> &s2) {
-              return s1->Time() < s2->Time();
-            });
-  // Sorted by time means that, generally, only later entries can be strictly
-  // worse than earlier ones.  The exception is close ties on time.
-  int i = 0;
-  while (i < vec.size()) {
-    // First look backwards for states with the same time as us but strictly
-    // worse values.
-    int j = i - 1;
-    while (j >= 0) {
-      if (vec[j]->Time() + clips::State::eps < vec[i]->Time()) {
-        // Likely early exit.
-        break;
-      }
-      if (vec[j]->IsStrictlyWorseThan(*vec[i])) {
-        vec.erase(vec.begin() + j);
-        i -= 1; // index of our current item shifts left
-      }
-      --j;
-    }
-    // Now look forward for states that took longer to get to strictly worse
-    for (j = i + 1; j < vec.size();) {
-      if (vec[j]->IsStrictlyWorseThan(*vec[i])) {
-        vec.erase(vec.begin() + j);
-        continue;
-      }
-      ++j;
-    }
-    ++i;
+// CullEntriesInBin on every worker at once, for a bin too big to leave to
+// one: each worker culls a slice, and the slices are merged in a tree.
+void CullEntriesInBinParallel(StateVec &vec) {
+  std::vector<StateVec> slices(kNumWorkers);
+  for (size_t i = 0; i < vec.size(); ++i) {
+    slices[i * kNumWorkers / vec.size()].push_back(std::move(vec[i]));
+  }
+  RunWorkers(kNumWorkers, [&](int w) { clips::CullEntriesInBin(slices[w]); });
+  vec = clips::MergeParetoFronts(std::move(slices), kNumWorkers);
+}
+
+// Like CullEntriesInBin, but keeps only one state per grid cell of `tol`.
+void CullEntriesInBinApprox(StateVec &vec, const clips::Tolerance &tol) {
+  // Inserting in time order makes the earliest state the survivor of each
+  // cell.
+  clips::SortByTime(vec);
+  clips::EpsilonArchive archive(tol);
+  for (auto &entry : vec) {
+    archive.Insert(std::move(entry));
   }
+  vec = archive.TakeSorted();
 }
 
 void CullEntries(StateVec &vec) {
-  absl::flat_hash_map<clips::State::BinType, StateVec> bin_map;
+  clips::BinMap<StateVec> bin_map;
   for (auto &sp : vec) {
     auto &bin = bin_map[sp->Bin()];
     bin.push_back(std::move(sp));
   }
   vec.clear();
   for (auto &node : bin_map) {
-    CullEntriesInBin(node.second);
+    clips::CullEntriesInBin(node.second);
     for (auto &entry : node.second) {
       vec.push_back(std::move(entry));
     }
   }
 }
 
-void CullEntriesSharded(StateVec &vec) {
-  absl::flat_hash_map<clips::State::BinType, StateVec> bin_map;
-  for (auto &sp : vec) {
-    auto &bin = bin_map[sp->Bin()];
-    bin.push_back(std::move(sp));
+// Current resident set size of this process, in bytes.
+int64_t ResidentBytes() {
+  long pages = 0;
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (f != nullptr) {
+    if (fscanf(f, "%*s %ld", &pages) != 1) {
+      pages = 0;
+    }
+    fclose(f);
   }
-  vec.clear();
-  std::vector<StateVec *> parts;
-  for (auto &node : bin_map) {
-    parts.push_back(&node.second);
+  return int64_t{pages} * sysconf(_SC_PAGESIZE);
+}
+
+int64_t PhysicalMemoryBytes() {
+  return int64_t{sysconf(_SC_PHYS_PAGES)} * sysconf(_SC_PAGESIZE);
+}
+
+bool OverMemoryLimit(int64_t memory_limit) {
+  return clips::GetMemoryUsage().total > memory_limit;
+}
+
+// Decides when culling the pool pays for itself.
+//
+// A cull costs time proportional to the pool size, and saves the time that
+// would have been spent advancing the states it removes (and their
+// children).  Both rates, and the fraction of states a cull keeps, are
+// measured as the search runs.  Independently of cost, the pool is culled
+// whenever another stride of growth at the current rate would push the
+// process past its memory budget.
+class CullScheduler {
+public:
+  explicit CullScheduler(int64_t memory_budget)
+      : memory_budget_(memory_budget) {}
+
+  void RecordAdvance(size_t states_in, size_t states_out,
+                     absl::Duration elapsed) {
+    if (states_in > 0) {
+      advance_sec_per_state_ = absl::ToDoubleSeconds(elapsed) / states_in;
+      growth_ = double(states_out) / states_in;
+      if (!cull_measured_) {
+        cull_sec_per_state_ = advance_sec_per_state_;
+      }
+    }
   }
-  ForEachVec(parts, CullEntriesInBin);
-  for (auto &node : bin_map) {
-    for (auto &entry : node.second) {
-      vec.push_back(std::move(entry));
+
+  bool ShouldCull(size_t size) const {
+    if (size < kMinCullSize) {
+      return false;
+    }
+    if (ResidentBytes() * std::max(growth_, 1.) > memory_budget_) {
+      return true;
+    }
+    const double removed = size * (1. - keep_ratio_);
+    const double saved = removed * advance_sec_per_state_ * growth_;
+    const double cost = size * cull_sec_per_state_;
+    return saved > cost;
+  }
+
+  // Bins that have barely grown since they were last culled are left alone.
+  bool ShouldCullBin(const clips::State::BinType &bin, size_t size) const {
+    if (size < 2) {
+      return false;
+    }
+    auto it = bin_sizes_.find(bin);
+    return it == bin_sizes_.end() || size > it->second * kBinRegrowth;
+  }
+
+  void RecordBin(const clips::State::BinType &bin, size_t size) {
+    bin_sizes_[bin] = size;
+  }
+
+  void RecordCull(size_t before, size_t after, absl::Duration elapsed) {
+    if (before > 0) {
+      keep_ratio_ = double(after) / before;
+      cull_sec_per_state_ = absl::ToDoubleSeconds(elapsed) / before;
+      cull_measured_ = true;
+    }
+  }
+
+private:
+  // Pools this small are cheap to carry whether or not they're culled.
+  static constexpr size_t kMinCullSize = 10000;
+  static constexpr double kBinRegrowth = 1.25;
+
+  const int64_t memory_budget_;
+  // Until the first measurements come in, guess that a cull keeps half the
+  // pool, and costs about as much per state as advancing it (as of the
+  // latest advance).
+  double keep_ratio_ = 0.5;
+  double cull_sec_per_state_ = 0.;
+  bool cull_measured_ = false;
+  double advance_sec_per_state_ = 0.;
+  double growth_ = 1.;
+  clips::BinMap<size_t> bin_sizes_;
+};
+
+// Smaller bins aren't worth splitting between workers, however lopsided the
+// pool is.
+constexpr size_t kMinLargeBinSize = 1 << 16;
+
+// Cull every bin of the pool in parallel.  If a scheduler is given, only
+// the bins it picks are culled.
+//
+// The pieces of each bin are gathered together, then workers claim whole
+// bins, largest first, and unpack, cull and repack them.  Bins that aren't
+// culled are never unpacked.  If `large_bin_cull` is given, bins bigger
+// than a worker's share of the pool are first culled one at a time with
+// it instead, and it should use every worker.
+void CullEntriesSharded(
+    Frontier &pool, std::function<void(StateVec &)> cull_fn,
+    CullScheduler *scheduler = nullptr,
+    std::function<void(StateVec &)> large_bin_cull = nullptr) {
+  const size_t before = clips::PackedSize(pool);
+  const absl::Time start = absl::Now();
+  struct Bin {
+    clips::State::BinType key;
+    size_t size = 0;
+    Frontier pieces;
+    bool culled = false;
+  };
+  std::vector<Bin> bins;
+  {
+    clips::BinMap<size_t> index;
+    for (clips::PackedBin &piece : pool) {
+      auto it = index.emplace(piece.bin(), bins.size()).first;
+      if (it->second == bins.size()) {
+        bins.emplace_back();
+        bins.back().key = piece.bin();
+      }
+      bins[it->second].size += piece.size();
+      bins[it->second].pieces.push_back(std::move(piece));
+    }
+  }
+  pool.clear();
+  std::sort(bins.begin(), bins.end(),
+            [](const Bin &a, const Bin &b) { return a.size > b.size; });
+
+  std::vector<Frontier> out(kNumWorkers);
+  auto unpack = [](Bin &bin) {
+    StateVec states;
+    for (clips::PackedBin &piece : bin.pieces) {
+      piece.UnpackInto(&states);
+      piece = clips::PackedBin();
+    }
+    return states;
+  };
+  size_t first_shared = 0;
+  if (large_bin_cull != nullptr && kNumWorkers > 1) {
+    for (; first_shared < bins.size() &&
+           bins[first_shared].size >= kMinLargeBinSize &&
+           bins[first_shared].size * kNumWorkers > before;
+         ++first_shared) {
+      Bin &bin = bins[first_shared];
+      StateVec states = unpack(bin);
+      large_bin_cull(states);
+      bin.size = states.size();
+      bin.culled = true;
+      out[0].emplace_back(std::move(states));
+    }
+  }
+  std::atomic<size_t> next_bin{first_shared};
+  RunWorkers(kNumWorkers, [&](int w) {
+    for (size_t i; (i = next_bin.fetch_add(1)) < bins.size();) {
+      Bin &bin = bins[i];
+      if (scheduler != nullptr &&
+          !scheduler->ShouldCullBin(bin.key, bin.size)) {
+        for (clips::PackedBin &piece : bin.pieces) {
+          out[w].push_back(std::move(piece));
+        }
+        continue;
+      }
+      StateVec states = unpack(bin);
+      cull_fn(states);
+      bin.size = states.size();
+      bin.culled = true;
+      out[w].emplace_back(std::move(states));
+    }
+  });
+  for (Frontier &part : out) {
+    for (clips::PackedBin &piece : part) {
+      pool.push_back(std::move(piece));
+    }
+  }
+  if (scheduler != nullptr) {
+    // Skipped bins keep the size they were last culled at, so their growth
+    // adds up until they're worth culling again.
+    for (const Bin &bin : bins) {
+      if (bin.culled) {
+        scheduler->RecordBin(bin.key, bin.size);
+      }
     }
+    scheduler->RecordCull(before, clips::PackedSize(pool),
+                          absl::Now() - start);
   }
 }
 
+// Advance every state on the stack, and hand the results to `out`.
 void Advance(StateVec &prev, clips::State::LimitType goal_type,
-             double goal_value, double opt_time) {
-  StateVec next;
-
+             double goal_value, double opt_time, clips::PackingWriter &out) {
   while (!prev.empty()) {
     std::unique_ptr<clips::State> cur = std::move(prev.back());
     prev.pop_back();
-    for (auto &item : cur->Branches(goal_type, goal_value)) {
+    // Children that would be thrown away below for running past opt_time
+    // are rejected before they are built.
+    const double now = cur->Time();
+    auto keep = [&](const clips::State::BranchInfo &b) {
+      using Decision = clips::State::Decision;
+      const double t = now + b.seconds;
+      return b.decision == Decision::kReachLimit ||
+             b.decision == Decision::kWin || t < opt_time ||
+             (goal_type == clips::State::kTimeLimit && t >= goal_value);
+    };
+    for (auto &item : cur->Branches(goal_type, goal_value, keep)) {
       if (item->AtGoal(goal_type, goal_value) || item->Win()) {
-        next.push_back(std::move(item));
+        out.Push(std::move(item));
       } else if (item->Time() < opt_time) {
         prev.push_back(std::move(item));
       }
     }
   }
-  prev = std::move(next);
 }
 
-void AdvanceSharded(StateVec &s, clips::State::LimitType goal_type,
-                    double goal_value, double opt_time) {
-  if (s.size() < 240) {
-    Advance(s, goal_type, goal_value, opt_time);
-  } else {
-    StateVec vec_shards[24];
-    int i = 0;
-    for (auto &entry : s) {
-      vec_shards[(i++) % 24].push_back(std::move(entry));
+// Packed bins set aside in a temporary file.
+class SpillFile {
+public:
+  SpillFile() = default;
+  SpillFile(const SpillFile &) = delete;
+  SpillFile &operator=(const SpillFile &) = delete;
+  ~SpillFile() {
+    if (file_ != nullptr) {
+      fclose(file_);
     }
-    std::vector<StateVec *> addrs;
-    for (int i = 0; i < 24; ++i) {
-      addrs.push_back(&vec_shards[i]);
+  }
+
+  size_t bytes() const { return bytes_; }
+
+  // Write out every bin in `bins`, and release them.
+  void Write(Frontier &bins) {
+    if (file_ == nullptr) {
+      file_ = Create();
     }
-    ForEachVec(addrs, [goal_type, goal_value, opt_time](StateVec &v) {
-      Advance(v, goal_type, goal_value, opt_time);
-    });
-    s.clear();
-    for (StateVec &result_vec : vec_shards) {
-      for (auto &item : result_vec) {
-        s.push_back(std::move(item));
+    std::string batch;
+    auto write_batch = [&]() {
+      const uint64_t size = batch.size();
+      if (fwrite(&size, sizeof(size), 1, file_) != 1 ||
+          fwrite(batch.data(), 1, size, file_) != size) {
+        Die("search: can't write spill file");
+      }
+      bytes_ += size;
+      batch.clear();
+    };
+    for (clips::PackedBin &piece : bins) {
+      piece.AppendTo(&batch);
+      piece = clips::PackedBin();
+      if (batch.size() >= kBatchBytes) {
+        write_batch();
+      }
+    }
+    if (!batch.empty()) {
+      write_batch();
+    }
+    bins.clear();
+  }
+
+  // Read back everything written, onto the end of `out`, and empty the file.
+  void ReadInto(Frontier *out) {
+    if (file_ == nullptr) {
+      return;
+    }
+    rewind(file_);
+    std::string batch;
+    for (uint64_t size; fread(&size, sizeof(size), 1, file_) == 1;) {
+      batch.resize(size);
+      if (fread(&batch[0], 1, size, file_) != size ||
+          !clips::PackedBin::ParseAll(batch, out)) {
+        Die("search: bad spill file");
+      }
+    }
+    fclose(file_);
+    file_ = nullptr;
+    bytes_ = 0;
+  }
+
+private:
+  // Spilled bins are read back a batch of about this many bytes at a time.
+  static constexpr size_t kBatchBytes = 4 << 20;
+
+  // An unnamed file in --spill_dir.
+  static FILE *Create() {
+    std::string path = absl::GetFlag(FLAGS_spill_dir) + "/search-XXXXXX";
+    const int fd = mkstemp(&path[0]);
+    FILE *f = fd < 0 ? nullptr : fdopen(fd, "w+b");
+    if (f == nullptr) {
+      Die("search: can't create a spill file in " +
+          absl::GetFlag(FLAGS_spill_dir));
+    }
+    unlink(path.c_str());
+    return f;
+  }
+
+  FILE *file_ = nullptr;
+  size_t bytes_ = 0;
+};
+
+// AdvanceSharded() hands out whole pieces of the pool, so pieces bigger than
+// this share of a worker's part of the pool are split first.  Otherwise one
+// big bin, which a cull leaves in a single piece, would be advanced by one
+// worker while the rest sat idle.  Pieces are never split below
+// kMinClaimSize states, or left above PackingWriter::kPieceSize.
+constexpr int kClaimsPerWorker = 8;
+constexpr size_t kMinClaimSize = 64;
+
+void SplitForWorkers(Frontier &pool, int num_workers) {
+  const size_t max_size = std::min(
+      clips::PackingWriter::kPieceSize,
+      std::max(kMinClaimSize,
+               clips::PackedSize(pool) / (num_workers * kClaimsPerWorker)));
+  std::vector<Frontier> out(num_workers);
+  std::atomic<size_t> next_piece{0};
+  RunWorkers(num_workers, [&](int w) {
+    for (size_t i; (i = next_piece.fetch_add(1)) < pool.size();) {
+      if (pool[i].size() > max_size) {
+        pool[i].SplitInto(max_size, &out[w]);
+      } else {
+        out[w].push_back(std::move(pool[i]));
       }
+      pool[i] = clips::PackedBin();
+    }
+  });
+  pool.clear();
+  for (Frontier &part : out) {
+    for (clips::PackedBin &piece : part) {
+      pool.push_back(std::move(piece));
     }
   }
 }
 
-int main() {
-  StateVec pool;
-  pool.push_back(absl::make_unique<clips::State>());
-  int stride = 25;
-  for (int i = stride; i < 1100; i += stride) {
-    AdvanceSharded(pool, clips::State::kTimeLimit, i, time_upper_bound);
-    std::cout << absl::FormatTime("%H:%M:%E2S", absl::Now(),
-                                  absl::UTCTimeZone())
-              << " " << i << " " << pool.size() << "";
-    if (i % 100 == 0) {
-      CullEntriesSharded(pool);
+// Advance every state in the pool.  Workers claim packed bins, unpack them
+// a state at a time, and pack what they reach as they go, so the pool is
+// never all unpacked at once.
+//
+// Each worker packs into a Frontier of its own, so nothing is shared while
+// they run.  The Frontiers are joined on this thread afterwards, which only
+// moves one handle per packed piece, not any states.
+//
+// Once the counted memory passes `memory_limit`, the workers stop claiming
+// bins and what they've reached so far is culled.  If that isn't enough, it
+// is spilled to disk until the rest of the pool has been advanced.  If even
+// that isn't enough, the bins not yet advanced are over the limit on their
+// own, and the workers are let past it a little at a time.
+void AdvanceSharded(Frontier &pool, clips::State::LimitType goal_type,
+                    double goal_value, double opt_time,
+                    int64_t memory_limit) {
+  const int num_workers = clips::PackedSize(pool) < 240 ? 1 : kNumWorkers;
+  if (num_workers > 1) {
+    SplitForWorkers(pool, num_workers);
+  }
+  Frontier reached;
+  SpillFile spill;
+  std::atomic<size_t> next_bin{0};
+  int64_t limit = memory_limit;
+  while (next_bin < pool.size()) {
+    std::vector<Frontier> out(num_workers);
+    RunWorkers(num_workers, [&](int w) {
+      clips::PackingWriter writer(&out[w]);
+      StateVec stack;
+      for (size_t i; (i = next_bin.fetch_add(1)) < pool.size();) {
+        for (clips::PackedBin::Reader reader(pool[i]); !reader.Done();) {
+          stack.push_back(reader.Next());
+          Advance(stack, goal_type, goal_value, opt_time, writer);
+        }
+        pool[i] = clips::PackedBin();
+        if (OverMemoryLimit(limit)) {
+          break;
+        }
+      }
+    });
+    for (Frontier &part : out) {
+      for (clips::PackedBin &piece : part) {
+        reached.push_back(std::move(piece));
+      }
+    }
+    if (next_bin < pool.size()) {
+      const size_t before = clips::PackedSize(reached);
+      CullEntriesSharded(reached, clips::CullEntriesInBin);
+      std::cerr << absl::StrFormat(
+          "search: over the memory limit at t=%g with %d of %d bins "
+          "advanced; culled %d states to %d\n",
+          goal_value, next_bin.load(), pool.size(), before,
+          clips::PackedSize(reached));
+      if (OverMemoryLimit(memory_limit)) {
+        spill.Write(reached);
+        std::cerr << absl::StrFormat("search: spilled %d MiB to disk\n",
+                                     spill.bytes() >> 20);
+      }
+      limit = std::max(memory_limit,
+                       clips::GetMemoryUsage().total + memory_limit / 4);
     }
-    std::cout << " " << pool.size() << "\n";
   }
-  AdvanceSharded(pool, clips::State::kTimeLimit, 15000., time_upper_bound);
+  pool = std::move(reached);
+  spill.ReadInto(&pool);
+}
+
+// How (and how often) a search process culls its pool.
+struct CullPolicy {
+  explicit CullPolicy(int64_t memory_budget) : scheduler(memory_budget) {}
+
+  clips::Tolerance tol;
+  bool approx = false;
+  bool adaptive = true;
+  std::function<void(StateVec &)> stride_cull = clips::CullEntriesInBin;
+  CullScheduler scheduler;
+  // Past this many counted bytes, advancing stops to cull (see
+  // AdvanceSharded()), and the pool is culled after the stride whatever the
+  // schedule says.
+  int64_t memory_limit = 0;
+  int approx_culls = 0;
+};
+
+CullPolicy CullPolicyFromFlags(int64_t memory_budget) {
+  CullPolicy policy(memory_budget);
+  clips::Tolerance &tol = policy.tol;
+  tol.time = absl::GetFlag(FLAGS_approx_time);
+  tol.dollars = absl::GetFlag(FLAGS_approx_dollars);
+  tol.ops = absl::GetFlag(FLAGS_approx_ops);
+  tol.creat = absl::GetFlag(FLAGS_approx_creat);
+  tol.clips = absl::GetFlag(FLAGS_approx_clips);
+  policy.approx = tol.time > 0. || tol.dollars > 0. || tol.ops > 0. ||
+                  tol.creat > 0. || tol.clips > 0.;
+  if (policy.approx) {
+    policy.stride_cull = [tol](StateVec &v) { CullEntriesInBinApprox(v, tol); };
+  }
+  policy.adaptive = absl::GetFlag(FLAGS_adaptive_cull);
+  policy.memory_limit = absl::GetFlag(FLAGS_memory_limit_mb) << 20;
+  if (policy.memory_limit <= 0) {
+    policy.memory_limit = memory_budget;
+  }
+  return policy;
+}
+
+int64_t MemoryBudgetFromFlags(int num_processes) {
+  int64_t memory_budget = absl::GetFlag(FLAGS_memory_budget_mb) << 20;
+  if (memory_budget <= 0) {
+    memory_budget = PhysicalMemoryBytes() / 10 * 8 / num_processes;
+  }
+  return memory_budget;
+}
+
+// Advance the pool to the given goal time, for the scheduler's benefit.
+// Starts a new memory high-water mark for the stride.
+void AdvanceStride(Frontier &pool, double goal, CullPolicy &policy) {
+  clips::ResetMemoryPeak();
+  const size_t states_in = clips::PackedSize(pool);
+  const absl::Time start = absl::Now();
+  AdvanceSharded(pool, clips::State::kTimeLimit, goal, time_upper_bound,
+                 policy.memory_limit);
+  policy.scheduler.RecordAdvance(states_in, clips::PackedSize(pool),
+                                 absl::Now() - start);
+}
+
+// Cull the pool if it's due after reaching stride `i`.  The final cull is
+// always exact.
+void MaybeCull(Frontier &pool, int i, bool final, CullPolicy &policy) {
+  if (final) {
+    CullEntriesSharded(pool, clips::CullEntriesInBin, nullptr,
+                       CullEntriesInBinParallel);
+  } else if (OverMemoryLimit(policy.memory_limit)) {
+    // Every bin, not just the ones the scheduler would pick.
+    CullEntriesSharded(pool, policy.stride_cull);
+    policy.approx_culls += policy.approx ? 1 : 0;
+  } else if (policy.adaptive
+                 ? policy.scheduler.ShouldCull(clips::PackedSize(pool))
+                 : i % 100 == 0) {
+    CullEntriesSharded(pool, policy.stride_cull,
+                       policy.adaptive ? &policy.scheduler : nullptr);
+    policy.approx_culls += policy.approx ? 1 : 0;
+  }
+}
+
+void PrintStride(int i, size_t before, size_t after) {
   std::cout << absl::FormatTime("%H:%M:%E2S", absl::Now(), absl::UTCTimeZone())
-            << " " << 15000 << " " << pool.size() << "";
-  CullEntriesSharded(pool);
-  std::cout << " " << pool.size() << "\n";
-}
\ No newline at end of file
+            << " " << i << " " << before << " " << after << "\n";
+}
+
+// Report the most memory a stride had counted at once, and what held it.
+void PrintMemoryPeak(int64_t peak,
+                     const std::array<int64_t, clips::kNumMemoryKinds> &bytes) {
+  auto mib = [](int64_t b) { return b / double(1 << 20); };
+  std::string line = absl::StrFormat("  peak %.1f MiB:", mib(peak));
+  for (int k = 0; k < clips::kNumMemoryKinds; ++k) {
+    absl::StrAppendFormat(
+        &line, "%s %s %.1f", k == 0 ? "" : ",",
+        clips::MemoryKindName(static_cast<clips::MemoryKind>(k)),
+        mib(bytes[k]));
+  }
+  std::cout << line << "\n";
+}
+
+void PrintApproxBound(const clips::Tolerance &tol, int approx_culls) {
+  if (approx_culls > 0) {
+    // Each approximate cull replaces a state with one that trails it by less
+    // than one grid cell per resource, and those losses can stack.
+    std::cout << absl::StrFormat(
+        "%d approximate culls; a culled state led its replacement by under "
+        "t=%.3fs $=%.2f ops=%.1f cre=%.1f cp=%.1f\n",
+        approx_culls, approx_culls * tol.time, approx_culls * tol.dollars,
+        approx_culls * tol.ops, approx_culls * tol.creat,
+        approx_culls * tol.clips);
+  }
+}
+
+// The pool at the start of the game.
+clips::PackedBin StartingBin() {
+  StateVec start;
+  start.push_back(absl::make_unique<clips::State>());
+  return clips::PackedBin(std::move(start));
+}
+
+// Replay the wins in the pool, and add every state on their lines of play
+// to the memo table at `path`.  Returns false if the table can't be written.
+bool RecordWins(const Frontier &pool, const std::string &path) {
+  std::vector<clips::Plan> plans;
+  int incomplete = 0;
+  for (const clips::PackedBin &packed : pool) {
+    for (clips::PackedBin::Reader reader(packed); !reader.Done();) {
+      std::unique_ptr<clips::State> s = reader.Next();
+      if (!s->Win()) {
+        continue;
+      }
+      // A full purchase log may be missing the end of the plan.
+      if (s->HistorySize() == clips::State::kHistorySize) {
+        ++incomplete;
+        continue;
+      }
+      plans.emplace_back(s->HistoryBegin(),
+                         s->HistoryBegin() + s->HistorySize());
+    }
+  }
+  clips::ReplayOptions options;
+  options.until_win = true;
+  options.time_limit = kFinalGoal;
+  options.record_line = true;
+  clips::MemoWriter memo;
+  int replayed = 0;
+  for (const clips::ReplayResult &result : clips::ReplayPlans(plans, options)) {
+    if (result.valid) {
+      ++replayed;
+      for (const auto &s : result.line) {
+        memo.Record(*s, result.finish_time);
+      }
+    }
+  }
+  std::cout << absl::StrFormat(
+      "memo: replayed %d of %d wins (%d with full logs skipped), %d states\n",
+      replayed, plans.size() + incomplete, incomplete, memo.size());
+  if (!memo.Write(path)) {
+    std::cerr << "search: can't write memo table " << path << "\n";
+    return false;
+  }
+  return true;
+}
+
+int RunLocal() {
+  CullPolicy policy = CullPolicyFromFlags(MemoryBudgetFromFlags(1));
+  Frontier pool;
+  pool.push_back(StartingBin());
+  for (int i = kStride; i < kLastStride; i += kStride) {
+    AdvanceStride(pool, i, policy);
+    const size_t before = clips::PackedSize(pool);
+    MaybeCull(pool, i, false, policy);
+    PrintStride(i, before, clips::PackedSize(pool));
+    const clips::MemoryUsage usage = clips::GetMemoryUsage();
+    PrintMemoryPeak(usage.peak, usage.peak_bytes);
+  }
+  AdvanceStride(pool, kFinalGoal, policy);
+  const size_t before = clips::PackedSize(pool);
+  MaybeCull(pool, kFinalGoal, true, policy);
+  PrintStride(kFinalGoal, before, clips::PackedSize(pool));
+  const clips::MemoryUsage usage = clips::GetMemoryUsage();
+  PrintMemoryPeak(usage.peak, usage.peak_bytes);
+  PrintApproxBound(policy.tol, policy.approx_culls);
+  const std::string memo_file = absl::GetFlag(FLAGS_memo_file);
+  if (!memo_file.empty() && !RecordWins(pool, memo_file)) {
+    return 1;
+  }
+  return 0;
+}
+
+// Distributed search.
+//
+// The coordinator accepts a connection from each worker, hands out worker
+// indexes and the list of worker addresses, and then drives the strides.
+// Workers connect to each other in a full mesh.  Each worker owns the bins
+// whose StableBinHash() is its index mod the number of workers, so its
+// culls are exact.  After advancing its pool, a worker ships every state
+// it doesn't own to the owner in batches, then marks the end of the stride
+// to every peer.
+enum MessageType : uint32_t {
+  // worker -> coordinator; arg is the port the worker listens on for peers
+  kHello = 1,
+  // coordinator -> worker; arg is the worker's index, payload lists every
+  // worker's host:port, comma separated
+  kAssign,
+  // worker -> worker, first message on a peer connection; arg is the index
+  kPeerHello,
+  // coordinator -> worker; payload is the goal time, arg is 1 on the final
+  // stride
+  kAdvance,
+  // worker -> worker; payload is a batch of bins from PackedBin::AppendTo
+  kStates,
+  // worker -> worker; no more states this stride
+  kEndStride,
+  // worker -> coordinator; arg is the worker's approximate cull count,
+  // payload is a StrideReport
+  kStrideDone,
+  // coordinator -> worker
+  kShutdown,
+};
+
+// What a worker tells the coordinator after each stride.
+struct StrideReport {
+  // The worker's pool size before and after culling.
+  uint64_t before;
+  uint64_t after;
+  // The worker's memory high-water mark for the stride, as in MemoryUsage.
+  int64_t peak;
+  std::array<int64_t, clips::kNumMemoryKinds> peak_bytes;
+};
+
+// States are shipped in batches of about this many bytes.
+constexpr size_t kBatchBytes = 4 << 20;
+
+void ReceiveOrDie(clips::Connection &conn, clips::Message *msg,
+                  uint32_t expected_type) {
+  if (!conn.Receive(msg) || msg->type != expected_type) {
+    Die(absl::StrCat("search: protocol error waiting for message type ",
+                     expected_type));
+  }
+}
+
+// Send every bin this worker doesn't own to its owner, and take in what the
+// other workers send here.  Bins travel packed.
+void ExchangeStates(
+    Frontier &pool, int self,
+    const std::vector<std::unique_ptr<clips::Connection>> &peers) {
+  const int n = peers.size();
+  std::mutex inbox_mu;
+  Frontier inbox;
+  std::vector<std::thread> receivers;
+  for (int j = 0; j < n; ++j) {
+    if (j == self) {
+      continue;
+    }
+    receivers.emplace_back([&inbox_mu, &inbox, &peers, j]() {
+      clips::Message msg;
+      Frontier received;
+      while (true) {
+        if (!peers[j]->Receive(&msg)) {
+          Die(absl::StrCat("search: lost connection to worker ", j));
+        }
+        if (msg.type == kEndStride) {
+          break;
+        }
+        if (!clips::PackedBin::ParseAll(msg.payload, &received)) {
+          Die(absl::StrCat("search: bad batch from worker ", j));
+        }
+      }
+      std::lock_guard<std::mutex> lock(inbox_mu);
+      for (clips::PackedBin &piece : received) {
+        inbox.push_back(std::move(piece));
+      }
+    });
+  }
+  Frontier mine;
+  std::vector<std::string> batches(n);
+  auto send_batch = [&](int j) {
+    if (!peers[j]->Send(kStates, 0, batches[j])) {
+      Die(absl::StrCat("search: lost connection to worker ", j));
+    }
+    batches[j].clear();
+  };
+  for (clips::PackedBin &piece : pool) {
+    const int owner = clips::StableBinHash(piece.bin()) % n;
+    if (owner == self) {
+      mine.push_back(std::move(piece));
+      continue;
+    }
+    piece.AppendTo(&batches[owner]);
+    piece = clips::PackedBin();
+    if (batches[owner].size() >= kBatchBytes) {
+      send_batch(owner);
+    }
+  }
+  pool.clear();
+  for (int j = 0; j < n; ++j) {
+    if (j == self) {
+      continue;
+    }
+    if (!batches[j].empty()) {
+      send_batch(j);
+    }
+    if (!peers[j]->Send(kEndStride, 0)) {
+      Die(absl::StrCat("search: lost connection to worker ", j));
+    }
+  }
+  for (std::thread &t : receivers) {
+    t.join();
+  }
+  pool = std::move(inbox);
+  for (clips::PackedBin &piece : mine) {
+    pool.push_back(std::move(piece));
+  }
+}
+
+int RunWorker(const std::string &coordinator) {
+  std::pair<std::string, std::string> host_port =
+      absl::StrSplit(coordinator, ':');
+  int coordinator_port;
+  if (!absl::SimpleAtoi(host_port.second, &coordinator_port)) {
+    Die(absl::StrCat("search: bad --coordinator ", coordinator));
+  }
+  int peer_port;
+  int listen_fd = clips::ListenTcp(0, &peer_port);
+  std::unique_ptr<clips::Connection> coord =
+      clips::ConnectTcp(host_port.first, coordinator_port);
+  if (listen_fd < 0 || coord == nullptr ||
+      !coord->Send(kHello, peer_port)) {
+    Die(absl::StrCat("search: can't reach coordinator ", coordinator));
+  }
+  clips::Message msg;
+  ReceiveOrDie(*coord, &msg, kAssign);
+  const int self = msg.arg;
+  std::vector<std::string> addrs = absl::StrSplit(msg.payload, ',');
+  const int n = addrs.size();
+
+  // Connect to the workers before us, and accept the ones after.
+  std::vector<std::unique_ptr<clips::Connection>> peers(n);
+  for (int j = 0; j < self; ++j) {
+    std::pair<std::string, std::string> addr = absl::StrSplit(addrs[j], ':');
+    int port = 0;
+    if (absl::SimpleAtoi(addr.second, &port)) {
+      peers[j] = clips::ConnectTcp(addr.first, port);
+    }
+    if (peers[j] == nullptr || !peers[j]->Send(kPeerHello, self)) {
+      Die(absl::StrCat("search: can't reach worker ", j, " at ", addrs[j]));
+    }
+  }
+  for (int k = self + 1; k < n; ++k) {
+    std::unique_ptr<clips::Connection> conn = clips::AcceptTcp(listen_fd);
+    if (conn == nullptr) {
+      Die("search: accept failed");
+    }
+    ReceiveOrDie(*conn, &msg, kPeerHello);
+    peers[msg.arg] = std::move(conn);
+  }
+  close(listen_fd);
+
+  CullPolicy policy = CullPolicyFromFlags(MemoryBudgetFromFlags(1));
+  Frontier pool;
+  clips::PackedBin start = StartingBin();
+  if (static_cast<int>(clips::StableBinHash(start.bin()) % n) == self) {
+    pool.push_back(std::move(start));
+  }
+  while (true) {
+    if (!coord->Receive(&msg)) {
+      Die("search: lost connection to coordinator");
+    }
+    if (msg.type == kShutdown) {
+      return 0;
+    }
+    double goal;
+    if (msg.type != kAdvance || msg.payload.size() != sizeof(goal)) {
+      Die("search: protocol error waiting for a stride");
+    }
+    memcpy(&goal, msg.payload.data(), sizeof(goal));
+    const bool final = msg.arg == 1;
+    AdvanceStride(pool, goal, policy);
+    ExchangeStates(pool, self, peers);
+    StrideReport report;
+    report.before = clips::PackedSize(pool);
+    MaybeCull(pool, goal, final, policy);
+    report.after = clips::PackedSize(pool);
+    const clips::MemoryUsage usage = clips::GetMemoryUsage();
+    report.peak = usage.peak;
+    report.peak_bytes = usage.peak_bytes;
+    if (!coord->Send(kStrideDone, policy.approx_culls,
+                     absl::string_view(reinterpret_cast<char *>(&report),
+                                       sizeof(report)))) {
+      Die("search: lost connection to coordinator");
+    }
+  }
+}
+
+// Start a worker process on this host, passing along the flags that shape
+// its search.
+pid_t SpawnWorker(int coordinator_port, int num_workers) {
+  std::vector<std::string> args = {
+      "search",
+      absl::StrCat("--coordinator=127.0.0.1:", coordinator_port),
+      absl::StrCat("--adaptive_cull=",
+                   absl::GetFlag(FLAGS_adaptive_cull) ? "true" : "false"),
+      absl::StrCat("--memory_budget_mb=",
+                   MemoryBudgetFromFlags(num_workers) >> 20),
+      absl::StrCat("--memory_limit_mb=",
+                   absl::GetFlag(FLAGS_memory_limit_mb) / num_workers),
+      absl::StrCat("--spill_dir=", absl::GetFlag(FLAGS_spill_dir)),
+      absl::StrCat("--approx_time=", absl::GetFlag(FLAGS_approx_time)),
+      absl::StrCat("--approx_dollars=", absl::GetFlag(FLAGS_approx_dollars)),
+      absl::StrCat("--approx_ops=", absl::GetFlag(FLAGS_approx_ops)),
+      absl::StrCat("--approx_creat=", absl::GetFlag(FLAGS_approx_creat)),
+      absl::StrCat("--approx_clips=", absl::GetFlag(FLAGS_approx_clips)),
+  };
+  pid_t pid = fork();
+  if (pid < 0) {
+    Die(absl::StrCat("search: can't fork worker: ", strerror(errno)));
+  }
+  if (pid == 0) {
+    std::vector<char *> argv;
+    for (std::string &arg : args) {
+      argv.push_back(&arg[0]);
+    }
+    argv.push_back(nullptr);
+    execv("/proc/self/exe", argv.data());
+    // Not Die(): exit() would run the parent's atexit handlers and flush its
+    // stdio buffers a second time.
+    static const char kError[] = "search: can't exec worker\n";
+    ssize_t ignored = write(STDERR_FILENO, kError, sizeof(kError) - 1);
+    (void)ignored;
+    _exit(127);
+  }
+  return pid;
+}
+
+int RunCoordinator(int num_workers) {
+  int port;
+  int listen_fd = clips::ListenTcp(absl::GetFlag(FLAGS_port), &port);
+  if (listen_fd < 0) {
+    Die("search: can't listen for workers");
+  }
+  std::vector<pid_t> children;
+  if (absl::GetFlag(FLAGS_spawn_workers)) {
+    for (int i = 0; i < num_workers; ++i) {
+      children.push_back(SpawnWorker(port, num_workers));
+    }
+  } else {
+    std::cerr << "waiting for " << num_workers << " workers on port " << port
+              << "\n";
+  }
+  std::vector<std::unique_ptr<clips::Connection>> workers;
+  std::vector<std::string> addrs;
+  clips::Message msg;
+  for (int i = 0; i < num_workers; ++i) {
+    workers.push_back(clips::AcceptTcp(listen_fd));
+    if (workers.back() == nullptr) {
+      Die("search: accept failed");
+    }
+    ReceiveOrDie(*workers.back(), &msg, kHello);
+    addrs.push_back(absl::StrCat(workers.back()->PeerHost(), ":", msg.arg));
+  }
+  close(listen_fd);
+  const std::string addr_list = absl::StrJoin(addrs, ",");
+  for (int i = 0; i < num_workers; ++i) {
+    if (!workers[i]->Send(kAssign, i, addr_list)) {
+      Die(absl::StrCat("search: lost connection to worker ", i));
+    }
+  }
+
+  const clips::Tolerance tol = CullPolicyFromFlags(0).tol;
+  int approx_culls = 0;
+  auto run_stride = [&](double goal, bool final) {
+    for (int i = 0; i < num_workers; ++i) {
+      if (!workers[i]->Send(kAdvance, final ? 1 : 0,
+                            absl::string_view(reinterpret_cast<char *>(&goal),
+                                              sizeof(goal)))) {
+        Die(absl::StrCat("search: lost connection to worker ", i));
+      }
+    }
+    uint64_t before = 0;
+    uint64_t after = 0;
+    // Each worker's high-water mark, summed.
+    int64_t peak = 0;
+    std::array<int64_t, clips::kNumMemoryKinds> peak_bytes = {};
+    for (int i = 0; i < num_workers; ++i) {
+      StrideReport report;
+      ReceiveOrDie(*workers[i], &msg, kStrideDone);
+      if (msg.payload.size() != sizeof(report)) {
+        Die("search: bad stride report");
+      }
+      memcpy(&report, msg.payload.data(), sizeof(report));
+      before += report.before;
+      after += report.after;
+      peak += report.peak;
+      for (int k = 0; k < clips::kNumMemoryKinds; ++k) {
+        peak_bytes[k] += report.peak_bytes[k];
+      }
+      approx_culls = std::max<int>(approx_culls, msg.arg);
+    }
+    PrintStride(goal, before, after);
+    PrintMemoryPeak(peak, peak_bytes);
+  };
+  for (int i = kStride; i < kLastStride; i += kStride) {
+    run_stride(i, false);
+  }
+  run_stride(kFinalGoal, true);
+  PrintApproxBound(tol, approx_culls);
+
+  for (auto &worker : workers) {
+    worker->Send(kShutdown, 0);
+  }
+  for (pid_t pid : children) {
+    waitpid(pid, nullptr, 0);
+  }
+  return 0;
+}
+
+// Every state reachable from `start` before `time_limit`.
+template <typename S> size_t CountNodes(const S &start, double time_limit) {
+  std::vector<std::unique_ptr<S>> stack;
+  stack.push_back(absl::make_unique<S>(start));
+  size_t nodes = 0;
+  while (!stack.empty()) {
+    std::unique_ptr<S> s = std::move(stack.back());
+    stack.pop_back();
+    for (auto &child : s->Branches(S::kTimeLimit, time_limit)) {
+      ++nodes;
+      if (!child->AtGoal(S::kTimeLimit, time_limit)) {
+        stack.push_back(std::move(child));
+      }
+    }
+  }
+  return nodes;
+}
+
+// Walk the double and fixed-point search trees side by side up to
+// `time_limit`.  Each pair of states must branch on the same decisions;
+// where they do, report how far apart their resources drift.
+int RunCrossCheck(double time_limit) {
+  using clips::FixedState;
+  using clips::State;
+  absl::Time start = absl::Now();
+  const size_t double_nodes = CountNodes(State(), time_limit);
+  const absl::Duration double_time = absl::Now() - start;
+  start = absl::Now();
+  const size_t fixed_nodes = CountNodes(FixedState(), time_limit);
+  const absl::Duration fixed_time = absl::Now() - start;
+  std::cout << absl::StrFormat("double: %d states in %s\n", double_nodes,
+                               absl::FormatDuration(double_time));
+  std::cout << absl::StrFormat("fixed:  %d states in %s\n", fixed_nodes,
+                               absl::FormatDuration(fixed_time));
+
+  using Pair = std::pair<std::unique_ptr<State>, std::unique_ptr<FixedState>>;
+  std::vector<Pair> stack;
+  stack.emplace_back(absl::make_unique<State>(),
+                     absl::make_unique<FixedState>());
+  size_t pairs = 0;
+  size_t mismatches = 0;
+  double drift[5] = {0., 0., 0., 0., 0.};
+  while (!stack.empty()) {
+    Pair p = std::move(stack.back());
+    stack.pop_back();
+    std::vector<int> double_decisions;
+    std::vector<int> fixed_decisions;
+    auto double_branches = p.first->Branches(
+        State::kTimeLimit, time_limit, [&](const State::BranchInfo &b) {
+          double_decisions.push_back(static_cast<int>(b.decision));
+          return true;
+        });
+    auto fixed_branches = p.second->Branches(
+        FixedState::kTimeLimit, time_limit,
+        [&](const FixedState::BranchInfo &b) {
+          fixed_decisions.push_back(static_cast<int>(b.decision));
+          return true;
+        });
+    if (double_decisions != fixed_decisions) {
+      if (++mismatches <= 3) {
+        std::cout << "branches differ after:\n"
+                  << *p.first << p.first->Detail() << *p.second
+                  << p.second->Detail();
+      }
+      continue;
+    }
+    for (size_t i = 0; i < double_branches.size(); ++i) {
+      const State &d = *double_branches[i];
+      const FixedState &f = *fixed_branches[i];
+      ++pairs;
+      drift[0] = std::max(drift[0], std::abs(d.Time() - f.Time()));
+      drift[1] = std::max(drift[1], std::abs(d.Dollars() - f.Dollars()));
+      drift[2] = std::max(drift[2], std::abs(d.Ops() - f.Ops()));
+      drift[3] = std::max(drift[3], std::abs(d.Creat() - f.Creat()));
+      drift[4] = std::max(drift[4], std::abs(d.Clips() - f.Clips()));
+      if (!d.AtGoal(State::kTimeLimit, time_limit)) {
+        stack.emplace_back(std::move(double_branches[i]),
+                           std::move(fixed_branches[i]));
+      }
+    }
+  }
+  std::cout << absl::StrFormat(
+      "%d state pairs, %d mismatched branchings; max drift t=%g $=%g ops=%g "
+      "cre=%g cp=%g\n",
+      pairs, mismatches, drift[0], drift[1], drift[2], drift[3], drift[4]);
+  return mismatches == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+  absl::ParseCommandLine(argc, argv);
+  if (absl::GetFlag(FLAGS_cross_check_until) > 0.) {
+    return RunCrossCheck(absl::GetFlag(FLAGS_cross_check_until));
+  }
+  if (!absl::GetFlag(FLAGS_coordinator).empty()) {
+    return RunWorker(absl::GetFlag(FLAGS_coordinator));
+  }
+  if (absl::GetFlag(FLAGS_num_workers) > 0) {
+    return RunCoordinator(absl::GetFlag(FLAGS_num_workers));
+  }
+  return RunLocal();
+}
@@ -0,0 +1,56 @@
+// Replays purchase plans read from stdin, one per line in the form
+// State::History() prints, and reports when each can be done.
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_join.h"
+#include "clips.h"
+#include "replay.h"
+
+ABSL_FLAG(bool, until_win, false,
+          "Only count a plan as done once it wins the game.");
+ABSL_FLAG(double, time_limit, 15000., "Give up on lines of play past this.");
+ABSL_FLAG(int, threads, 0, "Replay threads (0 means one per core).");
+ABSL_FLAG(bool, verbose, false,
+          "Also print each purchase time, and the final state.");
+
+int main(int argc, char **argv) {
+  absl::ParseCommandLine(argc, argv);
+  std::vector<clips::Plan> plans;
+  std::vector<bool> parsed;
+  for (std::string line; std::getline(std::cin, line);) {
+    plans.emplace_back();
+    parsed.push_back(clips::ParsePlan(line, &plans.back()));
+  }
+
+  clips::ReplayOptions options;
+  options.until_win = absl::GetFlag(FLAGS_until_win);
+  options.time_limit = absl::GetFlag(FLAGS_time_limit);
+  std::vector<clips::ReplayResult> results =
+      clips::ReplayPlans(plans, options, absl::GetFlag(FLAGS_threads));
+
+  int invalid = 0;
+  for (size_t i = 0; i < plans.size(); ++i) {
+    const clips::ReplayResult &result = results[i];
+    if (!parsed[i] || !result.valid) {
+      ++invalid;
+      std::cout << absl::StrFormat("%d: invalid\n", i);
+      continue;
+    }
+    std::cout << absl::StrFormat("%d: %.5f\n", i, result.finish_time);
+    if (absl::GetFlag(FLAGS_verbose)) {
+      std::cout << "  "
+                << absl::StrJoin(result.purchase_times, " ",
+                                 [](std::string *out, double t) {
+                                   absl::StrAppendFormat(out, "%.3f", t);
+                                 })
+                << "\n  " << *result.final_state;
+    }
+  }
+  return invalid == 0 ? 0 : 1;
+}